@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AssetLoader.h"
+
+// all loader state is shared between the workers and the render thread and guarded by one mutex
+static std::mutex                   loaderMutex;
+static std::condition_variable      loadQueued;     // signalled when loads gets an entry or on stop
+static std::condition_variable      loadFinished;   // signalled when a worker is done with an asset
+static std::deque<AsyncAsset*>      loads;
+static std::deque<AsyncAsset*>      uploads;
+static std::vector<AsyncAsset*>     loading;        // taken by a worker, not yet in uploads
+static std::vector<std::thread>     workers;
+static bool                         stopping = false;
+
+static void removeFrom(std::deque<AsyncAsset*>& queue, AsyncAsset* asset)
+{
+	queue.erase(std::remove(queue.begin(), queue.end(), asset), queue.end());
+}
+
+void AssetLoader::runWorker()
+{
+	std::unique_lock<std::mutex> lock(loaderMutex);
+	for(;;)
+	{
+		while(!stopping && loads.empty())
+			loadQueued.wait(lock);
+		if(stopping)
+			return;
+
+		AsyncAsset* asset = loads.front();
+		loads.pop_front();
+		loading.push_back(asset);
+
+		lock.unlock();
+		asset->loadData();
+		lock.lock();
+
+		loading.erase(std::find(loading.begin(), loading.end(), asset));
+		asset->state.store(AsyncAsset::LOADED, std::memory_order_release);
+		uploads.push_back(asset);
+		loadFinished.notify_all();
+	}
+}
+
+void AssetLoader::start(unsigned int threads)
+{
+	if(!workers.empty())
+		return;
+	if(threads == 0)
+		threads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+	stopping = false;
+	for(unsigned int i = 0; i < threads; i++)
+		workers.push_back(std::thread(&AssetLoader::runWorker));
+}
+
+void AssetLoader::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(loaderMutex);
+		stopping = true;
+	}
+	loadQueued.notify_all();
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+
+	std::lock_guard<std::mutex> lock(loaderMutex);
+	loads.clear();
+	uploads.clear();
+}
+
+void AssetLoader::submit(AsyncAsset* asset)
+{
+	if(workers.empty())
+	{
+		asset->loadData();
+		asset->state.store(AsyncAsset::LOADED, std::memory_order_release);
+		asset->uploadData();
+		asset->state.store(AsyncAsset::READY, std::memory_order_release);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(loaderMutex);
+		loads.push_back(asset);
+	}
+	loadQueued.notify_one();
+}
+
+void AssetLoader::cancel(AsyncAsset* asset)
+{
+	// after stop() nothing refers to the asset; assets destroyed during exit() may also
+	// come after the queues, so they are not touched. Only the render thread writes stopping
+	if(asset->isReady() || stopping)
+		return;
+
+	std::unique_lock<std::mutex> lock(loaderMutex);
+	removeFrom(loads, asset);
+	while(std::find(loading.begin(), loading.end(), asset) != loading.end())
+		loadFinished.wait(lock);
+	removeFrom(uploads, asset);
+}
+
+unsigned int AssetLoader::finishUploads(double seconds)
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point startTime = Clock::now();
+
+	unsigned int uploaded = 0;
+	for(;;)
+	{
+		AsyncAsset* asset;
+		{
+			std::lock_guard<std::mutex> lock(loaderMutex);
+			if(uploads.empty())
+				break;
+			asset = uploads.front();
+			uploads.pop_front();
+		}
+		asset->uploadData();
+		asset->state.store(AsyncAsset::READY, std::memory_order_release);
+		uploaded++;
+
+		if(std::chrono::duration<double>(Clock::now() - startTime).count() >= seconds)
+			break;
+	}
+	return uploaded;
+}
+
+unsigned int AssetLoader::getPendingCount()
+{
+	std::lock_guard<std::mutex> lock(loaderMutex);
+	return (unsigned int)(loads.size() + loading.size() + uploads.size());
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+
+// An asset that is loaded in two steps: loadData() reads and decodes the file
+// into CPU memory and may run on a worker thread, uploadData() hands the result
+// to GL and always runs on the thread that owns the context.
+class   AsyncAsset
+{
+	friend class AssetLoader;
+
+	enum { LOADING, LOADED, READY };
+	std::atomic<int>    state;
+
+public:
+	AsyncAsset() : state(LOADING) {}
+	virtual ~AsyncAsset() {}
+
+	// CPU side data such as bounds can be read once this is true
+	bool        isLoaded() const { return state.load(std::memory_order_acquire) >= LOADED; }
+	// GL objects exist and the asset can be drawn
+	bool        isReady() const { return state.load(std::memory_order_acquire) == READY; }
+
+protected:
+	virtual void loadData() = 0;
+	virtual void uploadData() = 0;
+};
+
+// Worker threads that run AsyncAsset::loadData(), and the queue of assets
+// waiting for their upload on the render thread.
+// Until start() is called, submit() loads and uploads on the spot.
+class   AssetLoader
+{
+	static void runWorker();
+
+public:
+	// 0 picks one thread per core, leaving one for the render thread
+	static void start(unsigned int threads);
+	// waits for the asset being loaded, assets still queued or waiting for their upload
+	// are left as they are and forgotten; cancel() has nothing to do after this
+	static void stop();
+
+	// call as the last step of the asset's constructor
+	static void submit(AsyncAsset* asset);
+	// call first thing in the asset's destructor, waits if a worker is loading it
+	static void cancel(AsyncAsset* asset);
+
+	// uploads loaded assets until seconds have passed, at least one per call so
+	// loading always makes progress; returns the number of assets uploaded
+	static unsigned int finishUploads(double seconds);
+	// assets submitted and not yet uploaded
+	static unsigned int getPendingCount();
+};
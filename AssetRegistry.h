@@ -0,0 +1,118 @@
+#pragma once
+#include <map>
+#include <string>
+
+// Shares loaded assets between everything that uses the same file.
+// acquire() hands out a reference that the caller owns and has to give back
+// with release(); retain() adds one for every extra holder of the pointer.
+// Assets nobody references any more stay loaded until evictUnused(), so an
+// asset that is dropped and needed again right after is not reloaded.
+// Every acquire() counts as a hit when the file was already loaded, as a miss
+// when it had to be loaded.
+template<class T>
+class   AssetRegistry
+{
+	struct  Entry
+	{
+		std::string path;
+		int         references;
+	};
+
+	std::map<std::string, T*>   byPath;
+	std::map<T*, Entry>         entries;
+	unsigned int                hits;
+	unsigned int                misses;
+
+public:
+	AssetRegistry() : hits(0), misses(0) {}
+
+	// the GL context is gone by the time globals are destroyed, so whatever is
+	// still registered then is left to the process teardown
+	~AssetRegistry() {}
+
+	T* acquire(const char *path)
+	{
+		typename std::map<std::string, T*>::iterator found = byPath.find(path);
+		if(found != byPath.end())
+		{
+			hits++;
+			entries[found->second].references++;
+			return found->second;
+		}
+
+		misses++;
+		T* asset = new T(path);
+		Entry entry = { path, 1 };
+		byPath[path] = asset;
+		entries[asset] = entry;
+		return asset;
+	}
+
+	// pointers the registry does not know about are ignored by retain and release
+	void retain(T* asset)
+	{
+		typename std::map<T*, Entry>::iterator found = entries.find(asset);
+		if(found != entries.end())
+			found->second.references++;
+	}
+
+	void release(T* asset)
+	{
+		typename std::map<T*, Entry>::iterator found = entries.find(asset);
+		if(found != entries.end() && found->second.references > 0)
+			found->second.references--;
+	}
+
+	void evictUnused()
+	{
+		typename std::map<T*, Entry>::iterator iEntry = entries.begin();
+		while(iEntry != entries.end())
+		{
+			if(iEntry->second.references == 0)
+			{
+				byPath.erase(iEntry->second.path);
+				delete iEntry->first;
+				entries.erase(iEntry++);
+			}
+			else
+				++iEntry;
+		}
+	}
+
+	// the asset nobody references that was drawn longest ago, NULL when every
+	// asset is in use; needs T::getLastUsed()
+	T* findLeastRecentlyUsed() const
+	{
+		T* oldest = NULL;
+		for(typename std::map<T*, Entry>::const_iterator iEntry = entries.begin(); iEntry != entries.end(); ++iEntry)
+		{
+			if(iEntry->second.references == 0 && (oldest == NULL || iEntry->first->getLastUsed() < oldest->getLastUsed()))
+				oldest = iEntry->first;
+		}
+		return oldest;
+	}
+
+	// deletes one asset nobody references
+	void evict(T* asset)
+	{
+		typename std::map<T*, Entry>::iterator found = entries.find(asset);
+		if(found == entries.end() || found->second.references != 0)
+			return;
+		byPath.erase(found->second.path);
+		delete asset;
+		entries.erase(found);
+	}
+
+	size_t size() const { return entries.size(); }
+	unsigned int getHits() const { return hits; }
+	unsigned int getMisses() const { return misses; }
+
+	// memory the loaded assets hold on the GPU, needs T::getResidentBytes()
+	size_t getResidentBytes() const
+	{
+		size_t bytes = 0;
+		for(typename std::map<T*, Entry>::const_iterator iEntry = entries.begin(); iEntry != entries.end(); ++iEntry)
+			bytes += iEntry->first->getResidentBytes();
+		return bytes;
+	}
+};
@@ -0,0 +1,88 @@
+#include <stddef.h>
+
+#include "BillboardBatch.h"
+#include "GLExtensions.h"
+
+unsigned int BillboardBatch::drawCalls = 0;
+unsigned int BillboardBatch::spritesDrawn = 0;
+
+BillboardBatch::BillboardBatch() : vertexBuffer(0)
+{
+}
+
+static uint8_t toByte(float value)
+{
+	value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+	return (uint8_t)(value * 255.0f + 0.5f);
+}
+
+void BillboardBatch::add(const float3& center, const float3& xAxis, const float3& yAxis, const TextureAtlas::Sprite& sprite, const float4& color)
+{
+	// counter-clockwise from the sprite's first texel, as the quads were drawn one by one
+	static const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+	Vertex vertex;
+	vertex.color[0] = toByte(color.x);
+	vertex.color[1] = toByte(color.y);
+	vertex.color[2] = toByte(color.z);
+	vertex.color[3] = toByte(color.w);
+	for(int c = 0; c < 4; c++)
+	{
+		float3 corner = center + xAxis * corners[c][0] + yAxis * corners[c][1];
+		vertex.position[0] = corner.x;
+		vertex.position[1] = corner.y;
+		vertex.position[2] = corner.z;
+		vertex.texcoord[0] = corners[c][0] < 0 ? sprite.u0 : sprite.u1;
+		vertex.texcoord[1] = corners[c][1] < 0 ? sprite.v0 : sprite.v1;
+		vertices.push_back(vertex);
+	}
+}
+
+void BillboardBatch::draw()
+{
+	if(vertices.empty())
+		return;
+
+	const char* base = (const char*)&vertices[0];
+	if(GLExtensions::bufferObjects)
+	{
+		if(vertexBuffer == 0)
+			GLExtensions::genBuffers(1, &vertexBuffer);
+		// a new store every frame, so GL never waits for last frame's draw to finish with it
+		GLExtensions::bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		GLExtensions::bufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), base, GL_STREAM_DRAW);
+		base = 0;
+	}
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(Vertex), base + offsetof(Vertex, position));
+	glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), base + offsetof(Vertex, texcoord));
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), base + offsetof(Vertex, color));
+	glDrawArrays(GL_QUADS, 0, (GLsizei)vertices.size());
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	if(GLExtensions::bufferObjects)
+		GLExtensions::bindBuffer(GL_ARRAY_BUFFER, 0);
+
+	drawCalls++;
+	spritesDrawn += getSpriteCount();
+	vertices.clear();
+}
+
+unsigned int BillboardBatch::getDrawCalls()
+{
+	return drawCalls;
+}
+
+unsigned int BillboardBatch::getSpritesDrawn()
+{
+	return spritesDrawn;
+}
+
+void BillboardBatch::resetCounters()
+{
+	drawCalls = 0;
+	spritesDrawn = 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "TextureAtlas.h"
+#include "float3.h"
+#include "float4.h"
+
+// Sprites that share a texture and blend state, expanded into quads on the CPU and
+// drawn with one glDrawArrays. The vertices go into a streaming buffer object that
+// is refilled every frame, or are read from client memory without buffer objects.
+// Quads are drawn in the order they were added, so sorted sprites stay sorted.
+// The caller sets up texturing, blending and depth writes before draw().
+class   BillboardBatch
+{
+	struct  Vertex
+	{
+		float       position[3];
+		float       texcoord[2];
+		uint8_t     color[4];
+	};
+
+	std::vector<Vertex> vertices;
+	unsigned int        vertexBuffer;
+
+	static unsigned int drawCalls;
+	static unsigned int spritesDrawn;
+
+public:
+	BillboardBatch();
+
+	// corners at center -xAxis -yAxis .. center +xAxis +yAxis, the sprite's first texel at the first one
+	void        add(const float3& center, const float3& xAxis, const float3& yAxis, const TextureAtlas::Sprite& sprite, const float4& color);
+	unsigned int getSpriteCount() const { return (unsigned int)(vertices.size() / 4); }
+
+	// draws everything added since the last call, then starts over
+	void        draw();
+
+	// since the last reset, for per-frame statistics
+	static unsigned int getDrawCalls();
+	static unsigned int getSpritesDrawn();
+	static void resetCounters();
+};
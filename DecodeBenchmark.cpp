@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "DecodeBenchmark.h"
+#include "ImageDecoder.h"
+#include "stb_image.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// decodes filename iterations times, returns the milliseconds per decode and keeps the last image
+static double timeDecode(const char* filename, int iterations, DecodedImage& image)
+{
+	Clock::time_point start = Clock::now();
+	for(int iteration = 0; iteration < iterations; iteration++)
+	{
+		ImageDecoder::release(image);
+		if(!ImageDecoder::decode(filename, image))
+			return 0;
+	}
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+}
+
+// the SIMD JPEG kernels and the table-driven inflate, or the original code for both
+static void setFastPaths(bool enabled)
+{
+	stbi_set_jpeg_simd(enabled);
+	stbi_set_fast_inflate(enabled);
+}
+
+// largest difference of any channel between the two decodes
+static int getMaxDifference(const DecodedImage& a, const DecodedImage& b)
+{
+	size_t size = (size_t)a.width * a.height * a.components;
+	int difference = 0;
+	for(size_t i = 0; i < size; i++)
+		difference = std::max(difference, abs(a.pixels[i] - b.pixels[i]));
+	return difference;
+}
+
+void runDecodeBenchmark(const char* const *filenames, int count)
+{
+	const int iterations = 20;
+
+	printf("jpeg simd kernels %s\n", stbi_jpeg_simd_available() ? "available" : "not available");
+	printf("%-12s %11s %10s %10s %8s %9s\n", "image", "size", "ref ms", "fast ms", "speedup", "max diff");
+	for(int i = 0; i < count; i++)
+	{
+		DecodedImage reference, fast;
+		setFastPaths(false);
+		double referenceTime = timeDecode(filenames[i], iterations, reference);
+		setFastPaths(true);
+		double fastTime = timeDecode(filenames[i], iterations, fast);
+		if(!reference.pixels || !fast.pixels)
+		{
+			printf("%-12s cannot be decoded: %s\n", filenames[i], stbi_failure_reason());
+			ImageDecoder::release(reference);
+			ImageDecoder::release(fast);
+			continue;
+		}
+
+		printf("%-12s %5dx%-5d %10.3f %10.3f %7.2fx %9d\n", filenames[i], reference.width, reference.height,
+			referenceTime, fastTime, referenceTime / fastTime, getMaxDifference(reference, fast));
+		ImageDecoder::release(reference);
+		ImageDecoder::release(fast);
+	}
+}
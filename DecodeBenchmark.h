@@ -0,0 +1,6 @@
+#pragma once
+
+// Times the decode of each given image with stb_image's original code paths and with
+// its fast ones (SIMD JPEG kernels, table-driven inflate for PNG), checks that both
+// produce the same pixels and prints the results.
+void    runDecodeBenchmark(const char* const *filenames, int count);
@@ -0,0 +1,152 @@
+#include <string.h>
+#include <stdio.h>
+
+#include "GLExtensions.h"
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__)
+#include <GL/glx.h>
+#endif
+
+bool GLExtensions::bufferObjects = false;
+void (APIENTRY *GLExtensions::genBuffers)(GLsizei, GLuint*) = 0;
+void (APIENTRY *GLExtensions::deleteBuffers)(GLsizei, const GLuint*) = 0;
+void (APIENTRY *GLExtensions::bindBuffer)(GLenum, GLuint) = 0;
+void (APIENTRY *GLExtensions::bufferData)(GLenum, ptrdiff_t, const void*, GLenum) = 0;
+bool GLExtensions::halfFloatVertex = false;
+bool GLExtensions::persistentPixelBuffers = false;
+void (APIENTRY *GLExtensions::bufferStorage)(GLenum, ptrdiff_t, const void*, GLbitfield) = 0;
+void* (APIENTRY *GLExtensions::mapBufferRange)(GLenum, ptrdiff_t, ptrdiff_t, GLbitfield) = 0;
+GLsync (APIENTRY *GLExtensions::fenceSync)(GLenum, GLbitfield) = 0;
+GLenum (APIENTRY *GLExtensions::clientWaitSync)(GLsync, GLbitfield, uint64_t) = 0;
+void (APIENTRY *GLExtensions::deleteSync)(GLsync) = 0;
+bool GLExtensions::instancedDrawing = false;
+GLuint (APIENTRY *GLExtensions::createShader)(GLenum) = 0;
+void (APIENTRY *GLExtensions::shaderSource)(GLuint, GLsizei, const GLchar* const*, const GLint*) = 0;
+void (APIENTRY *GLExtensions::compileShader)(GLuint) = 0;
+void (APIENTRY *GLExtensions::getShaderiv)(GLuint, GLenum, GLint*) = 0;
+void (APIENTRY *GLExtensions::getShaderInfoLog)(GLuint, GLsizei, GLsizei*, GLchar*) = 0;
+void (APIENTRY *GLExtensions::deleteShader)(GLuint) = 0;
+GLuint (APIENTRY *GLExtensions::createProgram)() = 0;
+void (APIENTRY *GLExtensions::attachShader)(GLuint, GLuint) = 0;
+void (APIENTRY *GLExtensions::bindAttribLocation)(GLuint, GLuint, const GLchar*) = 0;
+void (APIENTRY *GLExtensions::linkProgram)(GLuint) = 0;
+void (APIENTRY *GLExtensions::getProgramiv)(GLuint, GLenum, GLint*) = 0;
+void (APIENTRY *GLExtensions::getProgramInfoLog)(GLuint, GLsizei, GLsizei*, GLchar*) = 0;
+void (APIENTRY *GLExtensions::deleteProgram)(GLuint) = 0;
+void (APIENTRY *GLExtensions::useProgram)(GLuint) = 0;
+GLint (APIENTRY *GLExtensions::getUniformLocation)(GLuint, const GLchar*) = 0;
+void (APIENTRY *GLExtensions::uniform1i)(GLint, GLint) = 0;
+void (APIENTRY *GLExtensions::uniform1iv)(GLint, GLsizei, const GLint*) = 0;
+void (APIENTRY *GLExtensions::uniform3f)(GLint, GLfloat, GLfloat, GLfloat) = 0;
+void (APIENTRY *GLExtensions::vertexAttribPointer)(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) = 0;
+void (APIENTRY *GLExtensions::enableVertexAttribArray)(GLuint) = 0;
+void (APIENTRY *GLExtensions::disableVertexAttribArray)(GLuint) = 0;
+void (APIENTRY *GLExtensions::vertexAttribDivisor)(GLuint, GLuint) = 0;
+void (APIENTRY *GLExtensions::drawElementsInstanced)(GLenum, GLsizei, GLenum, const void*, GLsizei) = 0;
+bool GLExtensions::npotTextures = false;
+
+static void* getProcAddress(const char *name)
+{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
+	void* proc = (void*)wglGetProcAddress(name);
+	// some drivers hand back small sentinel values instead of NULL
+	if(proc == (void*)1 || proc == (void*)2 || proc == (void*)3 || proc == (void*)-1)
+		return 0;
+	return proc;
+#else
+	return (void*)glXGetProcAddress((const GLubyte*)name);
+#endif
+}
+
+// looks up the core name first and the extension suffixed one if that is missing
+template<class T>
+static bool resolve(T& function, const char *name, const char *suffix)
+{
+	function = (T)getProcAddress(name);
+	if(function == 0)
+	{
+		char suffixed[64];
+		sprintf(suffixed, "%s%s", name, suffix);
+		function = (T)getProcAddress(suffixed);
+	}
+	return function != 0;
+}
+
+void GLExtensions::load()
+{
+	if(hasVersion(1, 5) || hasExtension("GL_ARB_vertex_buffer_object"))
+	{
+		bufferObjects = resolve(genBuffers, "glGenBuffers", "ARB")
+			&& resolve(deleteBuffers, "glDeleteBuffers", "ARB")
+			&& resolve(bindBuffer, "glBindBuffer", "ARB")
+			&& resolve(bufferData, "glBufferData", "ARB");
+	}
+	if(bufferObjects && (hasVersion(2, 1) || hasExtension("GL_ARB_pixel_buffer_object"))
+		&& (hasVersion(4, 4) || hasExtension("GL_ARB_buffer_storage"))
+		&& (hasVersion(3, 0) || hasExtension("GL_ARB_map_buffer_range"))
+		&& (hasVersion(3, 2) || hasExtension("GL_ARB_sync")))
+	{
+		// the extensions use the core names
+		persistentPixelBuffers = resolve(bufferStorage, "glBufferStorage", "ARB")
+			&& resolve(mapBufferRange, "glMapBufferRange", "ARB")
+			&& resolve(fenceSync, "glFenceSync", "ARB")
+			&& resolve(clientWaitSync, "glClientWaitSync", "ARB")
+			&& resolve(deleteSync, "glDeleteSync", "ARB");
+	}
+	if(bufferObjects && hasVersion(2, 0)
+		&& (hasVersion(3, 1) || hasExtension("GL_ARB_draw_instanced"))
+		&& (hasVersion(3, 3) || hasExtension("GL_ARB_instanced_arrays")))
+	{
+		// shaders only under their core names, the ARB_shader_objects ones take handles
+		instancedDrawing = resolve(createShader, "glCreateShader", "")
+			&& resolve(shaderSource, "glShaderSource", "")
+			&& resolve(compileShader, "glCompileShader", "")
+			&& resolve(getShaderiv, "glGetShaderiv", "")
+			&& resolve(getShaderInfoLog, "glGetShaderInfoLog", "")
+			&& resolve(deleteShader, "glDeleteShader", "")
+			&& resolve(createProgram, "glCreateProgram", "")
+			&& resolve(attachShader, "glAttachShader", "")
+			&& resolve(bindAttribLocation, "glBindAttribLocation", "")
+			&& resolve(linkProgram, "glLinkProgram", "")
+			&& resolve(getProgramiv, "glGetProgramiv", "")
+			&& resolve(getProgramInfoLog, "glGetProgramInfoLog", "")
+			&& resolve(deleteProgram, "glDeleteProgram", "")
+			&& resolve(useProgram, "glUseProgram", "")
+			&& resolve(getUniformLocation, "glGetUniformLocation", "")
+			&& resolve(uniform1i, "glUniform1i", "")
+			&& resolve(uniform1iv, "glUniform1iv", "")
+			&& resolve(uniform3f, "glUniform3f", "")
+			&& resolve(vertexAttribPointer, "glVertexAttribPointer", "")
+			&& resolve(enableVertexAttribArray, "glEnableVertexAttribArray", "")
+			&& resolve(disableVertexAttribArray, "glDisableVertexAttribArray", "")
+			&& resolve(vertexAttribDivisor, "glVertexAttribDivisor", "ARB")
+			&& resolve(drawElementsInstanced, "glDrawElementsInstanced", "ARB");
+	}
+	halfFloatVertex = hasVersion(3, 0) || hasExtension("GL_ARB_half_float_vertex");
+	npotTextures = hasVersion(2, 0) || hasExtension("GL_ARB_texture_non_power_of_two");
+}
+
+bool GLExtensions::hasVersion(int major, int minor)
+{
+	const char* version = (const char*)glGetString(GL_VERSION);
+	int contextMajor = 0, contextMinor = 0;
+	if(version == NULL || sscanf(version, "%d.%d", &contextMajor, &contextMinor) != 2)
+		return false;
+	return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+bool GLExtensions::hasExtension(const char *name)
+{
+	const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+	if(extensions == NULL)
+		return false;
+
+	size_t length = strlen(name);
+	for(const char* p = strstr(extensions, name); p != NULL; p = strstr(p + length, name))
+	{
+		// only whole, space separated names count
+		if((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+			return true;
+	}
+	return false;
+}
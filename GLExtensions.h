@@ -0,0 +1,110 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
+// Needed on MsWindows
+#include <windows.h>
+#endif // Win32 platform
+
+#include <GL/gl.h>
+
+// OpenGL entry points newer than 1.1. The Windows opengl32.dll only exports 1.1,
+// so everything past that is looked up at runtime once a context exists.
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER                 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER         0x8893
+#define GL_STATIC_DRAW                  0x88E4
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW                  0x88E0
+#endif
+#ifndef GL_VERTEX_SHADER
+typedef char GLchar;
+#define GL_FRAGMENT_SHADER              0x8B30
+#define GL_VERTEX_SHADER                0x8B31
+#define GL_COMPILE_STATUS               0x8B81
+#define GL_LINK_STATUS                  0x8B82
+#endif
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT                   0x140B
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER          0x88EC
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_WRITE_BIT                0x0002
+#define GL_MAP_PERSISTENT_BIT           0x0040
+#define GL_MAP_COHERENT_BIT             0x0080
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+typedef struct __GLsync *GLsync;
+#define GL_SYNC_GPU_COMMANDS_COMPLETE   0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT      0x00000001
+#define GL_ALREADY_SIGNALED             0x911A
+#define GL_TIMEOUT_EXPIRED              0x911B
+#define GL_CONDITION_SATISFIED          0x911C
+#define GL_WAIT_FAILED                  0x911D
+#endif
+
+class   GLExtensions
+{
+public:
+	// vertex and index buffer objects, core in 1.5 and ARB_vertex_buffer_object before that
+	static bool bufferObjects;
+	static void (APIENTRY *genBuffers)(GLsizei n, GLuint *buffers);
+	static void (APIENTRY *deleteBuffers)(GLsizei n, const GLuint *buffers);
+	static void (APIENTRY *bindBuffer)(GLenum target, GLuint buffer);
+	static void (APIENTRY *bufferData)(GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+
+	// GL_HALF_FLOAT vertex attributes, core in 3.0 and ARB_half_float_vertex before that
+	static bool halfFloatVertex;
+
+	// pixel unpack buffers that stay mapped while GL reads them, and fences to tell when it is done:
+	// GL_PIXEL_UNPACK_BUFFER (2.1, ARB_pixel_buffer_object), glBufferStorage (4.4, ARB_buffer_storage),
+	// glMapBufferRange (3.0, ARB_map_buffer_range) and sync objects (3.2, ARB_sync)
+	static bool persistentPixelBuffers;
+	static void (APIENTRY *bufferStorage)(GLenum target, ptrdiff_t size, const void *data, GLbitfield flags);
+	static void* (APIENTRY *mapBufferRange)(GLenum target, ptrdiff_t offset, ptrdiff_t length, GLbitfield access);
+	static GLsync (APIENTRY *fenceSync)(GLenum condition, GLbitfield flags);
+	static GLenum (APIENTRY *clientWaitSync)(GLsync sync, GLbitfield flags, uint64_t timeout);
+	static void (APIENTRY *deleteSync)(GLsync sync);
+
+	// instanced draws with per-instance vertex attributes read by a GLSL 1.20 vertex shader:
+	// shaders (2.0), glDrawElementsInstanced (3.1, ARB_draw_instanced) and
+	// glVertexAttribDivisor (3.3, ARB_instanced_arrays)
+	static bool instancedDrawing;
+	static GLuint (APIENTRY *createShader)(GLenum type);
+	static void (APIENTRY *shaderSource)(GLuint shader, GLsizei count, const GLchar* const *strings, const GLint *lengths);
+	static void (APIENTRY *compileShader)(GLuint shader);
+	static void (APIENTRY *getShaderiv)(GLuint shader, GLenum pname, GLint *params);
+	static void (APIENTRY *getShaderInfoLog)(GLuint shader, GLsizei size, GLsizei *length, GLchar *log);
+	static void (APIENTRY *deleteShader)(GLuint shader);
+	static GLuint (APIENTRY *createProgram)();
+	static void (APIENTRY *attachShader)(GLuint program, GLuint shader);
+	static void (APIENTRY *bindAttribLocation)(GLuint program, GLuint index, const GLchar *name);
+	static void (APIENTRY *linkProgram)(GLuint program);
+	static void (APIENTRY *getProgramiv)(GLuint program, GLenum pname, GLint *params);
+	static void (APIENTRY *getProgramInfoLog)(GLuint program, GLsizei size, GLsizei *length, GLchar *log);
+	static void (APIENTRY *deleteProgram)(GLuint program);
+	static void (APIENTRY *useProgram)(GLuint program);
+	static GLint (APIENTRY *getUniformLocation)(GLuint program, const GLchar *name);
+	static void (APIENTRY *uniform1i)(GLint location, GLint value);
+	static void (APIENTRY *uniform1iv)(GLint location, GLsizei count, const GLint *values);
+	static void (APIENTRY *uniform3f)(GLint location, GLfloat x, GLfloat y, GLfloat z);
+	static void (APIENTRY *vertexAttribPointer)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer);
+	static void (APIENTRY *enableVertexAttribArray)(GLuint index);
+	static void (APIENTRY *disableVertexAttribArray)(GLuint index);
+	static void (APIENTRY *vertexAttribDivisor)(GLuint index, GLuint divisor);
+	static void (APIENTRY *drawElementsInstanced)(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instanceCount);
+
+	// texture sizes other than powers of two, core in 2.0 and ARB_texture_non_power_of_two before that
+	static bool npotTextures;
+
+	// needs a current context, call after the window has been created
+	static void load();
+
+	static bool hasVersion(int major, int minor);
+	static bool hasExtension(const char *name);
+};
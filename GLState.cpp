@@ -0,0 +1,274 @@
+#include <string.h>
+
+#include "GLState.h"
+
+// a cached parameter, up to 4 floats
+struct  CachedValue
+{
+	bool    known;
+	float   values[4];
+};
+
+static const GLenum trackedCaps[] = {
+	GL_TEXTURE_2D, GL_LIGHTING, GL_BLEND, GL_DEPTH_TEST, GL_NORMALIZE, GL_CULL_FACE,
+	GL_LIGHT0, GL_LIGHT1, GL_LIGHT2, GL_LIGHT3, GL_LIGHT4, GL_LIGHT5, GL_LIGHT6, GL_LIGHT7,
+};
+enum { CAP_COUNT = sizeof(trackedCaps) / sizeof(trackedCaps[0]), LIGHT_COUNT = 8 };
+
+enum { MATERIAL_AMBIENT, MATERIAL_DIFFUSE, MATERIAL_SPECULAR, MATERIAL_EMISSION, MATERIAL_SHININESS, MATERIAL_SLOTS };
+enum { LIGHT_AMBIENT, LIGHT_DIFFUSE, LIGHT_SPECULAR, LIGHT_CONSTANT_ATTENUATION, LIGHT_LINEAR_ATTENUATION,
+	LIGHT_QUADRATIC_ATTENUATION, LIGHT_SPOT_EXPONENT, LIGHT_SPOT_CUTOFF, LIGHT_SLOTS };
+
+// zero is unknown for everything, so the state starts out unknown
+enum { UNKNOWN, OFF, ON };
+
+static unsigned char    capStates[CAP_COUNT];
+static unsigned char    depthWrites;
+static bool             blendKnown;
+static GLenum           blendSource, blendDestination;
+static bool             textureKnown;
+static GLuint           boundTexture;
+static bool             texEnvKnown;
+static GLint            texEnv;
+static CachedValue      materials[MATERIAL_SLOTS];
+static CachedValue      lights[LIGHT_COUNT][LIGHT_SLOTS];
+
+static bool             contextAlive = true;
+
+static unsigned int     issued = 0;
+static unsigned int     filtered = 0;
+
+// true when the call has to go to GL, then values are what GL has from now on
+static bool changes(CachedValue& cached, const float *values, int count)
+{
+	if(cached.known && memcmp(cached.values, values, count * sizeof(float)) == 0)
+	{
+		filtered++;
+		return false;
+	}
+	cached.known = true;
+	memcpy(cached.values, values, count * sizeof(float));
+	issued++;
+	return true;
+}
+
+static int findCap(GLenum cap)
+{
+	for(int i = 0; i < CAP_COUNT; i++)
+	{
+		if(trackedCaps[i] == cap)
+			return i;
+	}
+	return -1;
+}
+
+static void setCap(GLenum cap, bool enabled)
+{
+	int i = findCap(cap);
+	if(i >= 0 && capStates[i] == (enabled ? ON : OFF))
+	{
+		filtered++;
+		return;
+	}
+	if(i >= 0)
+		capStates[i] = enabled ? ON : OFF;
+	issued++;
+	if(enabled)
+		glEnable(cap);
+	else
+		glDisable(cap);
+}
+
+void GLState::enable(GLenum cap)
+{
+	setCap(cap, true);
+}
+
+void GLState::disable(GLenum cap)
+{
+	setCap(cap, false);
+}
+
+bool GLState::isEnabled(GLenum cap)
+{
+	int i = findCap(cap);
+	if(i >= 0 && capStates[i] != UNKNOWN)
+		return capStates[i] == ON;
+	bool enabled = glIsEnabled(cap) == GL_TRUE;
+	if(i >= 0)
+		capStates[i] = enabled ? ON : OFF;
+	return enabled;
+}
+
+void GLState::depthMask(GLboolean flag)
+{
+	unsigned char writes = flag ? ON : OFF;
+	if(depthWrites == writes)
+	{
+		filtered++;
+		return;
+	}
+	depthWrites = writes;
+	issued++;
+	glDepthMask(flag);
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination)
+{
+	if(blendKnown && blendSource == source && blendDestination == destination)
+	{
+		filtered++;
+		return;
+	}
+	blendKnown = true;
+	blendSource = source;
+	blendDestination = destination;
+	issued++;
+	glBlendFunc(source, destination);
+}
+
+void GLState::bindTexture(GLuint texture)
+{
+	if(textureKnown && boundTexture == texture)
+	{
+		filtered++;
+		return;
+	}
+	textureKnown = true;
+	boundTexture = texture;
+	issued++;
+	glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void GLState::textureDeleted(GLuint texture)
+{
+	if(textureKnown && boundTexture == texture)
+		boundTexture = 0;
+}
+
+void GLState::texEnvMode(GLint mode)
+{
+	if(texEnvKnown && texEnv == mode)
+	{
+		filtered++;
+		return;
+	}
+	texEnvKnown = true;
+	texEnv = mode;
+	issued++;
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, mode);
+}
+
+static int materialSlot(GLenum pname)
+{
+	switch(pname)
+	{
+	case GL_AMBIENT: return MATERIAL_AMBIENT;
+	case GL_DIFFUSE: return MATERIAL_DIFFUSE;
+	case GL_SPECULAR: return MATERIAL_SPECULAR;
+	case GL_EMISSION: return MATERIAL_EMISSION;
+	case GL_SHININESS: return MATERIAL_SHININESS;
+	}
+	return -1;
+}
+
+void GLState::material(GLenum pname, const float *values)
+{
+	int slot = materialSlot(pname);
+	if(slot < 0)
+	{
+		// GL_AMBIENT_AND_DIFFUSE and the like, passed on and forgotten
+		materials[MATERIAL_AMBIENT].known = false;
+		materials[MATERIAL_DIFFUSE].known = false;
+		issued++;
+		glMaterialfv(GL_FRONT_AND_BACK, pname, values);
+		return;
+	}
+	if(changes(materials[slot], values, slot == MATERIAL_SHININESS ? 1 : 4))
+		glMaterialfv(GL_FRONT_AND_BACK, pname, values);
+}
+
+void GLState::material(GLenum pname, float value)
+{
+	material(pname, &value);
+}
+
+static int lightSlot(GLenum pname, int& count)
+{
+	count = 1;
+	switch(pname)
+	{
+	case GL_AMBIENT: count = 4; return LIGHT_AMBIENT;
+	case GL_DIFFUSE: count = 4; return LIGHT_DIFFUSE;
+	case GL_SPECULAR: count = 4; return LIGHT_SPECULAR;
+	case GL_CONSTANT_ATTENUATION: return LIGHT_CONSTANT_ATTENUATION;
+	case GL_LINEAR_ATTENUATION: return LIGHT_LINEAR_ATTENUATION;
+	case GL_QUADRATIC_ATTENUATION: return LIGHT_QUADRATIC_ATTENUATION;
+	case GL_SPOT_EXPONENT: return LIGHT_SPOT_EXPONENT;
+	case GL_SPOT_CUTOFF: return LIGHT_SPOT_CUTOFF;
+	}
+	return -1;
+}
+
+void GLState::light(GLenum light, GLenum pname, const float *values)
+{
+	int count;
+	int slot = lightSlot(pname, count);
+	int index = (int)light - GL_LIGHT0;
+	if(slot < 0 || index < 0 || index >= LIGHT_COUNT)
+	{
+		issued++;
+		glLightfv(light, pname, values);
+		return;
+	}
+	if(changes(lights[index][slot], values, count))
+		glLightfv(light, pname, values);
+}
+
+void GLState::light(GLenum light, GLenum pname, float value)
+{
+	GLState::light(light, pname, &value);
+}
+
+void GLState::invalidate()
+{
+	memset(capStates, UNKNOWN, sizeof(capStates));
+	depthWrites = UNKNOWN;
+	blendKnown = false;
+	textureKnown = false;
+	texEnvKnown = false;
+	for(int slot = 0; slot < MATERIAL_SLOTS; slot++)
+		materials[slot].known = false;
+	for(int index = 0; index < LIGHT_COUNT; index++)
+	{
+		for(int slot = 0; slot < LIGHT_SLOTS; slot++)
+			lights[index][slot].known = false;
+	}
+}
+
+void GLState::contextDestroyed()
+{
+	contextAlive = false;
+	invalidate();
+}
+
+bool GLState::hasContext()
+{
+	return contextAlive;
+}
+
+unsigned int GLState::getIssuedCalls()
+{
+	return issued;
+}
+
+unsigned int GLState::getFilteredCalls()
+{
+	return filtered;
+}
+
+void GLState::resetCounters()
+{
+	issued = 0;
+	filtered = 0;
+}
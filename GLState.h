@@ -0,0 +1,53 @@
+#pragma once
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
+// Needed on MsWindows
+#include <windows.h>
+#endif // Win32 platform
+
+#include <GL/gl.h>
+
+// Shadow copy of the fixed function state the scene sets over and over: capabilities,
+// depth mask, blend function, the bound 2D texture, the texture environment, material
+// colors and light parameters. A call that would set what is already set never reaches
+// GL. Values start unknown, so the first call always goes through.
+// Only valid while everything that changes this state goes through here; code that does
+// not has to call invalidate() afterwards. Render thread only.
+class   GLState
+{
+public:
+	static void enable(GLenum cap);
+	static void disable(GLenum cap);
+	// asks GL only while the capability is unknown or not tracked
+	static bool isEnabled(GLenum cap);
+	static void depthMask(GLboolean flag);
+	static void blendFunc(GLenum source, GLenum destination);
+
+	// GL_TEXTURE_2D of the active unit
+	static void bindTexture(GLuint texture);
+	// call after glDeleteTextures, GL falls back to texture 0 if it was bound
+	static void textureDeleted(GLuint texture);
+	// GL_TEXTURE_ENV_MODE
+	static void texEnvMode(GLint mode);
+
+	// GL_FRONT_AND_BACK, 4 values for the colors
+	static void material(GLenum pname, const float *values);
+	static void material(GLenum pname, float value);
+
+	// positions and spot directions depend on the modelview matrix at the time
+	// of the call, so they are always passed on
+	static void light(GLenum light, GLenum pname, const float *values);
+	static void light(GLenum light, GLenum pname, float value);
+
+	static void invalidate();
+
+	// call once the context is destroyed; from then on hasContext() is false and
+	// destructors leave their GL objects alone, they went with the context
+	static void contextDestroyed();
+	static bool hasContext();
+
+	// calls passed on to GL and calls dropped since the last reset
+	static unsigned int getIssuedCalls();
+	static unsigned int getFilteredCalls();
+	static void resetCounters();
+};
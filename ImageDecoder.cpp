@@ -0,0 +1,59 @@
+#include <limits.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "ImageDecoder.h"
+#include "MappedFile.h"
+#include "stb_image.h"
+
+static bool decodeMapped(const MappedFile& file, DecodedImage& image)
+{
+	if(!file.isOpen() || file.getSize() > INT_MAX)
+		return false;
+	image.pixels = stbi_load_from_memory((const stbi_uc*)file.begin(), (int)file.getSize(), &image.width, &image.height, &image.components, 0);
+	return image.pixels != 0;
+}
+
+bool ImageDecoder::decode(const char *filename, DecodedImage& image)
+{
+	MappedFile file(filename);
+	return decodeMapped(file, image);
+}
+
+// takes the next undecoded image until none are left
+static void decodeNext(const std::vector<MappedFile*>& files, std::vector<DecodedImage>& images, std::atomic<size_t>& next)
+{
+	for(size_t i = next++; i < files.size(); i = next++)
+		decodeMapped(*files[i], images[i]);
+}
+
+void ImageDecoder::decodeBatch(const std::vector<std::string>& filenames, std::vector<DecodedImage>& images, unsigned int threads)
+{
+	std::vector<MappedFile*> files(filenames.size());
+	for(size_t i = 0; i < filenames.size(); i++)
+		files[i] = new MappedFile(filenames[i].c_str());
+	images.assign(filenames.size(), DecodedImage());
+
+	// the calling thread decodes too
+	unsigned int nThreads = threads != 0 ? threads : std::thread::hardware_concurrency();
+	size_t nWorkers = std::min<size_t>(std::max(nThreads, 1u), files.size());
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	for(size_t i = 1; i < nWorkers; i++)
+		workers.push_back(std::thread(decodeNext, std::cref(files), std::ref(images), std::ref(next)));
+	decodeNext(files, images, next);
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	for(size_t i = 0; i < files.size(); i++)
+		delete files[i];
+}
+
+void ImageDecoder::release(DecodedImage& image)
+{
+	if(image.pixels != 0)
+		stbi_image_free(image.pixels);
+	image = DecodedImage();
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// 8 bits per channel pixels of a decoded image, first row at the top.
+// pixels is NULL when the file could not be read or decoded.
+struct  DecodedImage
+{
+	unsigned char*  pixels;
+	int             width;
+	int             height;
+	int             components;     // 1 grey, 2 grey alpha, 3 rgb, 4 rgba
+
+	DecodedImage() : pixels(0), width(0), height(0), components(0) {}
+};
+
+// Decodes image files through stb_image from memory mapped copies of the files,
+// so no file I/O happens inside the decoder. Safe to call from several threads.
+class   ImageDecoder
+{
+public:
+	static bool decode(const char *filename, DecodedImage& image);
+	// maps every file up front and decodes them on up to threads threads,
+	// 0 picks one per core; images[i] belongs to filenames[i]
+	static void decodeBatch(const std::vector<std::string>& filenames, std::vector<DecodedImage>& images, unsigned int threads);
+	static void release(DecodedImage& image);
+};
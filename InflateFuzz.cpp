@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "InflateFuzz.h"
+#include "MappedFile.h"
+#include "stb_image.h"
+
+typedef std::vector<unsigned char> Bytes;
+
+// damaged copies made of every stream, the same ones on every run
+static const int damagedCopies = 2000;
+
+static unsigned int nextRandom(unsigned int& state)
+{
+	// xorshift32
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static unsigned int readBigEndian(const unsigned char *p)
+{
+	return (unsigned int)p[0] << 24 | (unsigned int)p[1] << 16 | (unsigned int)p[2] << 8 | p[3];
+}
+
+// the IDAT chunks of a PNG file put back together, empty if it is not one
+static Bytes extractZlibStream(const char *filename)
+{
+	static const unsigned char signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+	Bytes stream;
+	MappedFile file(filename);
+	const unsigned char* p = (const unsigned char*)file.begin();
+	const unsigned char* end = p + file.getSize();
+	if(file.getSize() < 8 || memcmp(p, signature, 8) != 0)
+		return stream;
+	for(p += 8; end - p >= 12; )
+	{
+		unsigned int length = readBigEndian(p);
+		if(length > (size_t)(end - p) - 12)
+			break;
+		if(memcmp(p + 4, "IDAT", 4) == 0)
+			stream.insert(stream.end(), p + 8, p + 8 + length);
+		p += 12 + length;
+	}
+	return stream;
+}
+
+// data as a zlib stream of stored blocks, which the fast path hands to the original code
+static Bytes storeZlibStream(const Bytes& data)
+{
+	Bytes stream;
+	stream.push_back(0x78);
+	stream.push_back(0x01);
+	size_t offset = 0;
+	do
+	{
+		size_t length = data.size() - offset < 65535 ? data.size() - offset : 65535;
+		stream.push_back(offset + length == data.size() ? 1 : 0);
+		stream.push_back((unsigned char)length);
+		stream.push_back((unsigned char)(length >> 8));
+		stream.push_back((unsigned char)~length);
+		stream.push_back((unsigned char)(~length >> 8));
+		stream.insert(stream.end(), data.begin() + offset, data.begin() + offset + length);
+		offset += length;
+	} while(offset < data.size());
+
+	unsigned int a = 1, b = 0;
+	for(size_t i = 0; i < data.size(); i++)
+	{
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	unsigned int adler = b << 16 | a;
+	for(int shift = 24; shift >= 0; shift -= 8)
+		stream.push_back((unsigned char)(adler >> shift));
+	return stream;
+}
+
+// decodes with the fast path on or off; exactSize > 0 decodes into a buffer of that size
+static bool inflate(const Bytes& stream, bool fast, int exactSize, Bytes& output)
+{
+	stbi_set_fast_inflate(fast);
+	output.clear();
+	const char* input = stream.empty() ? "" : (const char*)&stream[0];
+	if(exactSize > 0)
+	{
+		output.resize(exactSize);
+		int length = stbi_zlib_decode_buffer((char*)&output[0], exactSize, input, (int)stream.size());
+		if(length < 0)
+			return false;
+		output.resize(length);
+		return true;
+	}
+	int length = 0;
+	char* decoded = stbi_zlib_decode_malloc(input, (int)stream.size(), &length);
+	if(decoded == NULL)
+		return false;
+	output.assign(decoded, decoded + length);
+	free(decoded);
+	return true;
+}
+
+struct  FuzzCounts
+{
+	unsigned int    identical;
+	unsigned int    bothRejected;
+	unsigned int    onlyFastRejected;
+	unsigned int    different;
+};
+
+// true if both modes agree, or may disagree the documented way when damaged is set
+static bool compareModes(const Bytes& stream, int exactSize, bool damaged, FuzzCounts& counts)
+{
+	Bytes original, fast;
+	bool originalOk = inflate(stream, false, exactSize, original);
+	bool fastOk = inflate(stream, true, exactSize, fast);
+	if(originalOk && fastOk && original == fast)
+		counts.identical++;
+	else if(!originalOk && !fastOk)
+		counts.bothRejected++;
+	else if(damaged && originalOk && !fastOk)
+		counts.onlyFastRejected++;
+	else
+	{
+		counts.different++;
+		return false;
+	}
+	return true;
+}
+
+static void damage(Bytes& stream, unsigned int& state)
+{
+	size_t at = nextRandom(state) % stream.size();
+	switch(nextRandom(state) % 4)
+	{
+	case 0:
+		for(unsigned int flips = 1 + nextRandom(state) % 4; flips > 0; flips--)
+			stream[nextRandom(state) % stream.size()] ^= (unsigned char)(1 << nextRandom(state) % 8);
+		break;
+	case 1:
+		stream[at] = (unsigned char)nextRandom(state);
+		break;
+	case 2:
+		for(size_t i = at; i < stream.size() && i < at + 1 + nextRandom(state) % 16; i++)
+			stream[i] = 0;
+		break;
+	default:
+		stream.resize(at);
+		break;
+	}
+}
+
+static void printCounts(const char *name, const char *kind, const FuzzCounts& counts)
+{
+	printf("%-12s %-8s %10u %10u %10u %10u\n", name, kind, counts.identical, counts.bothRejected, counts.onlyFastRejected, counts.different);
+}
+
+bool runInflateFuzz(const char* const *filenames, int count)
+{
+	bool passed = true;
+	printf("%-12s %-8s %10s %10s %10s %10s\n", "image", "streams", "identical", "rejected", "fast only", "different");
+	for(int i = 0; i < count; i++)
+	{
+		Bytes streams[2];
+		streams[0] = extractZlibStream(filenames[i]);
+		Bytes decoded;
+		if(streams[0].empty() || !inflate(streams[0], false, 0, decoded))
+		{
+			printf("%-12s has no zlib stream\n", filenames[i]);
+			continue;
+		}
+		streams[1] = storeZlibStream(decoded);
+
+		FuzzCounts valid = { 0, 0, 0, 0 }, damaged = { 0, 0, 0, 0 };
+		unsigned int state = 2463534242u + i;
+		for(int s = 0; s < 2; s++)
+		{
+			passed &= compareModes(streams[s], 0, false, valid);
+			passed &= compareModes(streams[s], (int)decoded.size(), false, valid);
+			for(int copy = 0; copy < damagedCopies; copy++)
+			{
+				Bytes stream = streams[s];
+				damage(stream, state);
+				if(stream.empty())
+					continue;
+				passed &= compareModes(stream, 0, true, damaged);
+				passed &= compareModes(stream, (int)decoded.size(), true, damaged);
+			}
+		}
+		printCounts(filenames[i], "valid", valid);
+		printCounts(filenames[i], "damaged", damaged);
+	}
+	stbi_set_fast_inflate(1);
+	printf("%s\n", passed ? "passed" : "FAILED");
+	return passed;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Round trip test of stb_image's table-driven inflate against its original decoder.
+// Takes the zlib streams out of the given PNG files, adds a stored-block copy of each,
+// and decodes them and damaged copies of them (flipped bits, overwritten and zeroed
+// bytes, cut off ends) in both modes, into growing buffers and into buffers of the
+// exact output size. Valid streams have to decode identically; damaged ones have to
+// give the same bytes or be rejected by both, except that the fast path may reject
+// symbols 286/287 and distances 30/31 the original accepts. Prints the counts and
+// returns false on any other difference. Run it under ASan/UBSan for the memory side.
+bool    runInflateFuzz(const char* const *filenames, int count);
@@ -0,0 +1,242 @@
+#include <stdio.h>
+
+#include "InstanceRenderer.h"
+#include "GLExtensions.h"
+#include "GLState.h"
+
+// the three rows take attributes 5-7; drivers that alias the fixed function arrays
+// onto numbered attributes put the fog coordinate and nothing else there
+enum { ROW_ATTRIBUTE = 5, LIGHT_COUNT = 8 };
+
+static const char* vertexSource =
+	"#version 120\n"
+	"attribute vec4 instanceRow0;\n"
+	"attribute vec4 instanceRow1;\n"
+	"attribute vec4 instanceRow2;\n"
+	"uniform vec3 dequantizationScale;\n"
+	"uniform vec3 dequantizationOffset;\n"
+	"uniform bool lighting;\n"
+	"uniform bool lightEnabled[8];\n"
+	"varying vec4 color;\n"
+	"varying vec2 texcoord;\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	vec4 local = vec4(gl_Vertex.xyz * dequantizationScale + dequantizationOffset, 1.0);\n"
+	"	vec4 world = vec4(dot(instanceRow0, local), dot(instanceRow1, local), dot(instanceRow2, local), 1.0);\n"
+	"	vec4 eye = gl_ModelViewMatrix * world;\n"
+	"	gl_Position = gl_ProjectionMatrix * eye;\n"
+	"	texcoord = (gl_TextureMatrix[0] * gl_MultiTexCoord0).xy;\n"
+	"	if(!lighting)\n"
+	"	{\n"
+	"		color = gl_Color;\n"
+	"		return;\n"
+	"	}\n"
+	"\n"
+	"	// the cofactors of the linear part turn normals like its inverse transpose, up to a scale\n"
+	"	vec3 a0 = instanceRow0.xyz * dequantizationScale;\n"
+	"	vec3 a1 = instanceRow1.xyz * dequantizationScale;\n"
+	"	vec3 a2 = instanceRow2.xyz * dequantizationScale;\n"
+	"	vec3 c0 = cross(a1, a2);\n"
+	"	vec3 c1 = cross(a2, a0);\n"
+	"	vec3 c2 = cross(a0, a1);\n"
+	"	vec3 n = vec3(dot(c0, gl_Normal), dot(c1, gl_Normal), dot(c2, gl_Normal)) * sign(dot(a0, c0));\n"
+	"	vec3 normal = normalize(gl_NormalMatrix * n);\n"
+	"\n"
+	"	// fixed function lighting: infinite viewer, no spot lights, front faces only\n"
+	"	vec4 sum = gl_FrontLightModelProduct.sceneColor;\n"
+	"	for(int i = 0; i < 8; i++)\n"
+	"	{\n"
+	"		if(!lightEnabled[i])\n"
+	"			continue;\n"
+	"		vec3 toLight;\n"
+	"		float attenuation = 1.0;\n"
+	"		if(gl_LightSource[i].position.w == 0.0)\n"
+	"			toLight = normalize(gl_LightSource[i].position.xyz);\n"
+	"		else\n"
+	"		{\n"
+	"			vec3 offset = gl_LightSource[i].position.xyz - eye.xyz;\n"
+	"			float range = length(offset);\n"
+	"			toLight = offset / range;\n"
+	"			attenuation = 1.0 / (gl_LightSource[i].constantAttenuation + gl_LightSource[i].linearAttenuation * range\n"
+	"				+ gl_LightSource[i].quadraticAttenuation * range * range);\n"
+	"		}\n"
+	"		float diffuse = max(dot(normal, toLight), 0.0);\n"
+	"		vec4 term = gl_FrontLightProduct[i].ambient + gl_FrontLightProduct[i].diffuse * diffuse;\n"
+	"		if(diffuse > 0.0)\n"
+	"			term += gl_FrontLightProduct[i].specular * pow(max(dot(normal, normalize(toLight + vec3(0.0, 0.0, 1.0))), 0.0), gl_FrontMaterial.shininess);\n"
+	"		sum += attenuation * term;\n"
+	"	}\n"
+	"	color = clamp(vec4(sum.rgb, gl_FrontMaterial.diffuse.a), 0.0, 1.0);\n"
+	"}\n";
+
+// GL_REPLACE is the only texture environment the scene uses
+static const char* fragmentSource =
+	"#version 120\n"
+	"uniform bool textured;\n"
+	"uniform sampler2D image;\n"
+	"varying vec4 color;\n"
+	"varying vec2 texcoord;\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	gl_FragColor = textured ? texture2D(image, texcoord) : color;\n"
+	"}\n";
+
+static GLuint   program = 0;
+static GLuint   instanceBuffer = 0;
+static GLint    dequantizationScale, dequantizationOffset, lighting, lightEnabled, textured;
+
+static unsigned int drawCalls = 0;
+static unsigned int instancesDrawn = 0;
+
+static GLuint compile(GLenum type, const char *source)
+{
+	GLuint shader = GLExtensions::createShader(type);
+	GLExtensions::shaderSource(shader, 1, &source, NULL);
+	GLExtensions::compileShader(shader);
+	GLint compiled = GL_FALSE;
+	GLExtensions::getShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if(compiled != GL_TRUE)
+	{
+		char log[1024] = "";
+		GLExtensions::getShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("instance shader: %s\n", log);
+		GLExtensions::deleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+bool InstanceRenderer::start()
+{
+	if(program != 0 || !GLExtensions::instancedDrawing)
+		return program != 0;
+
+	GLuint vertexShader = compile(GL_VERTEX_SHADER, vertexSource);
+	GLuint fragmentShader = compile(GL_FRAGMENT_SHADER, fragmentSource);
+	if(vertexShader == 0 || fragmentShader == 0)
+	{
+		if(vertexShader != 0)
+			GLExtensions::deleteShader(vertexShader);
+		if(fragmentShader != 0)
+			GLExtensions::deleteShader(fragmentShader);
+		return false;
+	}
+
+	GLuint linked = GLExtensions::createProgram();
+	GLExtensions::attachShader(linked, vertexShader);
+	GLExtensions::attachShader(linked, fragmentShader);
+	GLExtensions::bindAttribLocation(linked, ROW_ATTRIBUTE, "instanceRow0");
+	GLExtensions::bindAttribLocation(linked, ROW_ATTRIBUTE + 1, "instanceRow1");
+	GLExtensions::bindAttribLocation(linked, ROW_ATTRIBUTE + 2, "instanceRow2");
+	GLExtensions::linkProgram(linked);
+	// the program keeps them until it is deleted itself
+	GLExtensions::deleteShader(vertexShader);
+	GLExtensions::deleteShader(fragmentShader);
+	GLint status = GL_FALSE;
+	GLExtensions::getProgramiv(linked, GL_LINK_STATUS, &status);
+	if(status != GL_TRUE)
+	{
+		char log[1024] = "";
+		GLExtensions::getProgramInfoLog(linked, sizeof(log), NULL, log);
+		printf("instance program: %s\n", log);
+		GLExtensions::deleteProgram(linked);
+		return false;
+	}
+
+	program = linked;
+	dequantizationScale = GLExtensions::getUniformLocation(program, "dequantizationScale");
+	dequantizationOffset = GLExtensions::getUniformLocation(program, "dequantizationOffset");
+	lighting = GLExtensions::getUniformLocation(program, "lighting");
+	lightEnabled = GLExtensions::getUniformLocation(program, "lightEnabled");
+	textured = GLExtensions::getUniformLocation(program, "textured");
+	GLExtensions::useProgram(program);
+	GLExtensions::uniform1i(GLExtensions::getUniformLocation(program, "image"), 0);
+	GLExtensions::useProgram(0);
+
+	GLExtensions::genBuffers(1, &instanceBuffer);
+	return true;
+}
+
+void InstanceRenderer::stop()
+{
+	if(program == 0)
+		return;
+	GLExtensions::deleteProgram(program);
+	GLExtensions::deleteBuffers(1, &instanceBuffer);
+	program = 0;
+	instanceBuffer = 0;
+}
+
+bool InstanceRenderer::isStarted()
+{
+	return program != 0;
+}
+
+void InstanceRenderer::begin(const float *rows, size_t instanceCount)
+{
+	// a new store every frame, so GL never waits for last frame's draws to finish with it
+	GLExtensions::bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	GLExtensions::bufferData(GL_ARRAY_BUFFER, instanceCount * ROW_FLOATS * sizeof(float), rows, GL_STREAM_DRAW);
+	GLExtensions::bindBuffer(GL_ARRAY_BUFFER, 0);
+	GLExtensions::useProgram(program);
+	for(int row = 0; row < 3; row++)
+	{
+		GLExtensions::enableVertexAttribArray(ROW_ATTRIBUTE + row);
+		GLExtensions::vertexAttribDivisor(ROW_ATTRIBUTE + row, 1);
+	}
+}
+
+void InstanceRenderer::draw(Mesh *mesh, unsigned int lod, size_t firstInstance, unsigned int instanceCount)
+{
+	if(!mesh->canDrawInstanced())
+		return;
+
+	// there is no base instance before GL 4.2, the rows are pointed at the first one instead
+	const GLsizei stride = ROW_FLOATS * sizeof(float);
+	GLExtensions::bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for(int row = 0; row < 3; row++)
+		GLExtensions::vertexAttribPointer(ROW_ATTRIBUTE + row, 4, GL_FLOAT, GL_FALSE, stride, (const void*)(firstInstance * stride + row * 4 * sizeof(float)));
+	GLExtensions::bindBuffer(GL_ARRAY_BUFFER, 0);
+
+	const float* dequantization = mesh->getDequantization();
+	GLExtensions::uniform3f(dequantizationScale, dequantization[0], dequantization[5], dequantization[10]);
+	GLExtensions::uniform3f(dequantizationOffset, dequantization[12], dequantization[13], dequantization[14]);
+	GLExtensions::uniform1i(lighting, GLState::isEnabled(GL_LIGHTING));
+	GLExtensions::uniform1i(textured, GLState::isEnabled(GL_TEXTURE_2D));
+	GLint lights[LIGHT_COUNT];
+	for(int i = 0; i < LIGHT_COUNT; i++)
+		lights[i] = GLState::isEnabled(GL_LIGHT0 + i);
+	GLExtensions::uniform1iv(lightEnabled, LIGHT_COUNT, lights);
+
+	mesh->drawLodInstanced(lod, instanceCount);
+	drawCalls++;
+	instancesDrawn += instanceCount;
+}
+
+void InstanceRenderer::end()
+{
+	for(int row = 0; row < 3; row++)
+	{
+		GLExtensions::vertexAttribDivisor(ROW_ATTRIBUTE + row, 0);
+		GLExtensions::disableVertexAttribArray(ROW_ATTRIBUTE + row);
+	}
+	GLExtensions::useProgram(0);
+}
+
+unsigned int InstanceRenderer::getDrawCalls()
+{
+	return drawCalls;
+}
+
+unsigned int InstanceRenderer::getInstancesDrawn()
+{
+	return instancesDrawn;
+}
+
+void InstanceRenderer::resetCounters()
+{
+	drawCalls = 0;
+	instancesDrawn = 0;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+#include "Mesh.h"
+#include "float4x4.h"
+
+// Draws many copies of a mesh with one glDrawElementsInstanced. Every instance is the
+// top three rows of its model matrix (ROW_FLOATS floats), all instances of a frame sit
+// in one streaming buffer object, and a small GLSL 1.20 program places them and stands
+// in for the fixed function lighting and GL_REPLACE texturing. Materials, lights and
+// matrices come from the GL state at the time of draw(), like for any other mesh.
+// Render thread only.
+class   InstanceRenderer
+{
+public:
+	enum { ROW_FLOATS = 12 };
+
+	// needs GLExtensions::instancedDrawing and a current context, false leaves instancing off
+	static bool start();
+	static bool isStarted();
+	// deletes the program and the instance buffer, instancing is off afterwards
+	static void stop();
+
+	// uploads the rows of instanceCount instances and binds the program
+	static void begin(const float *rows, size_t instanceCount);
+	// instances firstInstance.. of the uploaded ones, with the mesh's level lod
+	static void draw(Mesh *mesh, unsigned int lod, size_t firstInstance, unsigned int instanceCount);
+	static void end();
+
+	// since the last reset, for per-frame statistics
+	static unsigned int getDrawCalls();
+	static unsigned int getInstancesDrawn();
+	static void resetCounters();
+};
+
+// Collects the mesh instances of a frame and draws them grouped by mesh, level of
+// detail and material, one instanced draw per group. A NULL material leaves the
+// state as the caller set it up, as for shadows.
+template<class Material>
+class   InstanceBatch
+{
+	struct  Instance
+	{
+		Mesh*           mesh;
+		unsigned int    lod;
+		Material*       material;
+		float           rows[InstanceRenderer::ROW_FLOATS];
+	};
+
+	std::vector<Instance>   instances;
+	std::vector<float>      rows;       // of the sorted instances, as uploaded
+
+	static bool groupOrder(const Instance& a, const Instance& b)
+	{
+		if(a.mesh != b.mesh)
+			return a.mesh < b.mesh;
+		if(a.lod != b.lod)
+			return a.lod < b.lod;
+		return a.material < b.material;
+	}
+
+public:
+	// model is a row vector matrix as in float4x4, its last column has to be 0, 0, 0, 1
+	void add(Mesh *mesh, unsigned int lod, Material *material, const float4x4& model)
+	{
+		Instance instance;
+		instance.mesh = mesh;
+		instance.lod = lod;
+		instance.material = material;
+		// float4x4 is laid out like a GL matrix, a GL row is every fourth float
+		for(int row = 0; row < 3; row++)
+		{
+			for(int k = 0; k < 4; k++)
+				instance.rows[row * 4 + k] = model.l[k * 4 + row];
+		}
+		instances.push_back(instance);
+	}
+
+	size_t size() const { return instances.size(); }
+
+	// draws everything added since the last call, then starts over
+	void draw()
+	{
+		if(instances.empty())
+			return;
+		std::sort(instances.begin(), instances.end(), groupOrder);
+		rows.resize(instances.size() * InstanceRenderer::ROW_FLOATS);
+		for(size_t i = 0; i < instances.size(); i++)
+			std::copy(instances[i].rows, instances[i].rows + InstanceRenderer::ROW_FLOATS, &rows[i * InstanceRenderer::ROW_FLOATS]);
+
+		InstanceRenderer::begin(&rows[0], instances.size());
+		for(size_t first = 0, last; first < instances.size(); first = last)
+		{
+			for(last = first + 1; last < instances.size() && !groupOrder(instances[first], instances[last]); last++)
+				;
+			// the fixed function state is still what the program reads
+			if(instances[first].material != NULL)
+				instances[first].material->apply();
+			InstanceRenderer::draw(instances[first].mesh, instances[first].lod, first, (unsigned int)(last - first));
+		}
+		InstanceRenderer::end();
+		instances.clear();
+	}
+};
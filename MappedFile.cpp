@@ -0,0 +1,73 @@
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
+// Needed on MsWindows
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // Win32 platform
+
+#include "MappedFile.h"
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
+
+MappedFile::MappedFile(const char *filename) : data(0), size(0), file(INVALID_HANDLE_VALUE), mapping(0)
+{
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if(file == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		return;
+
+	mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	if(mapping == 0)
+		return;
+
+	data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if(data != 0)
+		size = (size_t)fileSize.QuadPart;
+}
+
+MappedFile::~MappedFile()
+{
+	if(data != 0)
+		UnmapViewOfFile(data);
+	if(mapping != 0)
+		CloseHandle(mapping);
+	if(file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const char *filename) : data(0), size(0)
+{
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0)
+		return;
+
+	struct stat info;
+	if(fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		void* view = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(view != MAP_FAILED)
+		{
+			madvise(view, info.st_size, MADV_SEQUENTIAL);
+			data = (const char*)view;
+			size = (size_t)info.st_size;
+		}
+	}
+	// the mapping stays valid after the descriptor is closed
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if(data != 0)
+		munmap((void*)data, size);
+}
+
+#endif // Win32 platform
@@ -0,0 +1,27 @@
+#pragma once
+#include <stddef.h>
+
+// Read-only view of a whole file mapped into memory.
+// The contents are valid for the lifetime of the object.
+class   MappedFile
+{
+	const char*	data;
+	size_t		size;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
+	void*		file;
+	void*		mapping;
+#endif
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+public:
+	MappedFile(const char *filename);
+	~MappedFile();
+
+	bool        isOpen() const { return data != 0; }
+	const char* begin() const { return data; }
+	const char* end() const { return data + size; }
+	size_t      getSize() const { return size; }
+};
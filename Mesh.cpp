@@ -1,5 +1,3 @@
-#include <fstream>
-#include <algorithm> 
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
 // Needed on MsWindows
@@ -11,163 +9,1345 @@
 // Download glut from: http://www.opengl.org/resources/libraries/glut/
 #include <GL/glut.h>
 
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+
 #include "mesh.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "GLExtensions.h"
+#include "GLState.h"
+#include "MeshOptimizer.h"
+#include "MeshQuantization.h"
 
 
 using namespace std;
 
-Mesh::Mesh(const char *filename)
+// Hand-written tokenizer helpers for the OBJ loader. They work directly on the
+// mapped file contents and never step past the end pointer.
+
+static inline bool isBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* skipBlanks(const char* p, const char* end)
+{
+	while(p < end && isBlank(*p))
+		p++;
+	return p;
+}
+
+static inline const char* skipLine(const char* p, const char* end)
+{
+	while(p < end && *p != '\n')
+		p++;
+	return p < end ? p + 1 : end;
+}
+
+static const char* parseInt(const char* p, const char* end, int& value)
+{
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+
+	int result = 0;
+	while(p < end && *p >= '0' && *p <= '9')
+		result = result * 10 + (*p++ - '0');
+
+	value = negative ? -result : result;
+	return p;
+}
+
+static const char* parseFloat(const char* p, const char* end, float& value)
+{
+	static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+		1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	p = skipBlanks(p, end);
+
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+
+	double mantissa = 0.0;
+	while(p < end && *p >= '0' && *p <= '9')
+		mantissa = mantissa * 10.0 + (*p++ - '0');
+
+	int exponent = 0;
+	if(p < end && *p == '.')
+	{
+		p++;
+		while(p < end && *p >= '0' && *p <= '9')
+		{
+			mantissa = mantissa * 10.0 + (*p++ - '0');
+			exponent--;
+		}
+	}
+
+	if(p < end && (*p == 'e' || *p == 'E'))
+	{
+		int e;
+		p = parseInt(p + 1, end, e);
+		exponent += e;
+	}
+
+	while(exponent < -22)
+	{
+		mantissa /= 1e22;
+		exponent += 22;
+	}
+	while(exponent > 22)
+	{
+		mantissa *= 1e22;
+		exponent -= 22;
+	}
+	if(exponent < 0)
+		mantissa /= powersOfTen[-exponent];
+	else
+		mantissa *= powersOfTen[exponent];
+
+	value = (float)(negative ? -mantissa : mantissa);
+	return p;
+}
+
+// Parses one "v/t/n" face corner. Missing texcoord or normal indices are left at 0.
+static const char* parseFaceVertex(const char* p, const char* end, int& position, int& texcoord, int& normal)
+{
+	texcoord = normal = 0;
+	p = parseInt(p, end, position);
+	if(p < end && *p == '/')
+	{
+		p++;
+		if(p < end && *p != '/')
+			p = parseInt(p, end, texcoord);
+		if(p < end && *p == '/')
+			p = parseInt(p + 1, end, normal);
+	}
+	return p;
+}
+
+Mesh::Mesh() : Resident(MESH), modelid(0), vertexBuffer(0), indexBuffer(0), indexType(0), vertexCount(0), residentBytes(0), vertexFormat(defaultVertexFormat)
 {
-	fstream file(filename); 
-	if(!file.is_open())       
+	setDequantization(0, 0);
+	bounds.minimum = bounds.maximum = bounds.center = float3(0, 0, 0);
+	bounds.radius = 0.0f;
+}
+
+Mesh::Mesh(const char *filename) : Mesh()
+{
+	this->filename = filename;
+	AssetLoader::submit(this);
+}
+
+// runs on a loader thread, everything up to the GL calls
+void Mesh::loadData()
+{
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if(!getMeshSourceStamp(filename.c_str(), sourceSize, sourceTime))
 	{
 		return;
 	}
 
-	char buffer[256];
-	while(!file.eof())
+	std::string cachePath = getMeshCachePath(filename.c_str());
+	if(!loadCache(cachePath.c_str(), sourceSize, sourceTime))
 	{
-		file.getline(buffer,256);
-		rows.push_back(new string(buffer));
+		if(!loadObj(filename.c_str()))
+			return;
+		optimize();
+		generateLods();
+		if(vertexFormat != VERTEX_FORMAT_FLOAT)
+			quantize();
+		computeBounds();
+		saveCache(cachePath.c_str(), sourceSize, sourceTime);
 	}
 
-	submeshFaces.push_back(std::vector<Face*>());
-	std::vector<Face*>* faces = &submeshFaces.at(submeshFaces.size()-1);
+	if(GLExtensions::bufferObjects)
+		packBuffers();
+}
+
+void Mesh::uploadData()
+{
+	if(submeshes.empty())
+		return;
+	if(GLExtensions::bufferObjects)
+		uploadBuffers();
+	else
+		buildDisplayLists();
+}
 
-	for(int i = 0; i < rows.size(); i++)
+// Records parsed from one line-aligned slice of an .obj file. Positive indices are
+// already global; negative ones are relative to the records seen so far, so they
+// are only resolved against this chunk and fixed up when the chunks are merged.
+struct  Mesh::ObjChunk
+{
+	std::vector<float>          positions;
+	std::vector<float>          normals;
+	std::vector<float>          texcoords;
+	std::vector<Corner>         corners;
+	std::vector<unsigned int>   groupStarts;        // chunk-local triangle index of every "g" line
+	std::vector<unsigned int>   relativeIndices;    // corner * 4 + attribute (0 position, 1 texcoord, 2 normal)
+};
+
+unsigned int Mesh::loaderThreads = 0;
+int Mesh::defaultVertexFormat = Mesh::VERTEX_FORMAT_FLOAT;
+
+void Mesh::setLoaderThreads(unsigned int threads)
+{
+	loaderThreads = threads;
+}
+
+void Mesh::setVertexFormat(VertexFormat format)
+{
+	defaultVertexFormat = format;
+}
+
+size_t Mesh::parseObj(const char *filename)
+{
+	// never submitted and never uploaded, so destroying it touches neither the loader nor GL
+	Mesh mesh;
+	if(!mesh.loadObj(filename))
+		return 0;
+	return mesh.indices.size() / 3;
+}
+
+bool Mesh::analyzeObj(const char *filename, unsigned int cacheSize, VertexCacheStats& before, VertexCacheStats& after)
+{
+	Mesh mesh;
+	if(!mesh.loadObj(filename) || mesh.indices.empty())
+		return false;
+	before = analyzeVertexCache(&mesh.indices[0], mesh.indices.size(), mesh.positions.size() / 3, cacheSize);
+	mesh.optimize();
+	after = analyzeVertexCache(&mesh.indices[0], mesh.indices.size(), mesh.positions.size() / 3, cacheSize);
+	return true;
+}
+
+// Returns the 0-based index of an .obj index (1-based, or negative = relative
+// to the end of the list), -1 when it was left out.
+static inline int resolveIndex(int index, size_t count, std::vector<unsigned int>& relativeIndices, unsigned int slot)
+{
+	if(index > 0)
+		return index - 1;
+	if(index < 0)
 	{
-		if(rows[i]->empty() || (*rows[i])[0] == '#') 
-			continue;      
-		else if((*rows[i])[0] == 'v' && (*rows[i])[1] == ' ')
+		relativeIndices.push_back(slot);
+		return (int)count + index;
+	}
+	return -1;
+}
+
+void Mesh::parseObjChunk(const char *p, const char *end, ObjChunk& chunk)
+{
+	// quads are split into (0,1,2) and (1,2,3)
+	static const int quadCorners[6] = { 0, 1, 2, 1, 2, 3 };
+
+	while(p < end)
+	{
+		p = skipBlanks(p, end);
+		if(p == end)
+			break;
+
+		if(p[0] == 'v' && p + 1 < end && isBlank(p[1]))
 		{
 			float tmpx,tmpy,tmpz;
-			sscanf_s(rows[i]->c_str(), "v %f %f %f" ,&tmpx,&tmpy,&tmpz);      
-			positions.push_back(new float3(tmpx,tmpy,tmpz));  
+			p = parseFloat(p + 1, end, tmpx);
+			p = parseFloat(p, end, tmpy);
+			p = parseFloat(p, end, tmpz);
+			chunk.positions.push_back(tmpx);
+			chunk.positions.push_back(tmpy);
+			chunk.positions.push_back(tmpz);
 		}
-		else if((*rows[i])[0] == 'v' && (*rows[i])[1] == 'n')    
+		else if(p[0] == 'v' && p + 1 < end && p[1] == 'n')
 		{
-			float tmpx,tmpy,tmpz;   
-			sscanf_s(rows[i]->c_str(), "vn %f %f %f" ,&tmpx,&tmpy,&tmpz);
-			normals.push_back(new float3(tmpx,tmpy,tmpz));     
+			float tmpx,tmpy,tmpz;
+			p = parseFloat(p + 2, end, tmpx);
+			p = parseFloat(p, end, tmpy);
+			p = parseFloat(p, end, tmpz);
+			chunk.normals.push_back(tmpx);
+			chunk.normals.push_back(tmpy);
+			chunk.normals.push_back(tmpz);
 		}
-		else if((*rows[i])[0] == 'v' && (*rows[i])[1] == 't')
+		else if(p[0] == 'v' && p + 1 < end && p[1] == 't')
 		{
 			float tmpx,tmpy;
-			sscanf_s(rows[i]->c_str(), "vt %f %f" ,&tmpx,&tmpy);
-			texcoords.push_back(new float2(tmpx,tmpy));     
+			p = parseFloat(p + 2, end, tmpx);
+			p = parseFloat(p, end, tmpy);
+			chunk.texcoords.push_back(tmpx);
+			chunk.texcoords.push_back(tmpy);
 		}
-		else if((*rows[i])[0] == 'f')  
+		else if(p[0] == 'f' && p + 1 < end && isBlank(p[1]))
 		{
-			if(count(rows[i]->begin(),rows[i]->end(), ' ') == 3)
+			int face[4][3];
+			int nVertices = 0;
+			p = skipBlanks(p + 1, end);
+			while(p < end && *p != '\n' && nVertices < 4)
 			{
-				Face* f = new Face();
-				f->isQuad = false;
-				sscanf_s(rows[i]->c_str(), "f %d/%d/%d %d/%d/%d %d/%d/%d",
-					&f->positionIndices[0], &f->texcoordIndices[0], &f->normalIndices[0],
-					&f->positionIndices[1], &f->texcoordIndices[1], &f->normalIndices[1],
-					&f->positionIndices[2], &f->texcoordIndices[2], &f->normalIndices[2]);
-				faces->push_back(f);
+				p = parseFaceVertex(p, end, face[nVertices][0], face[nVertices][1], face[nVertices][2]);
+				nVertices++;
+				p = skipBlanks(p, end);
 			}
-			else
+			if(nVertices >= 3)
 			{
-				Face* f = new Face();
-				f->isQuad = true;
-				sscanf_s(rows[i]->c_str(), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d", 
-					&f->positionIndices[0], &f->texcoordIndices[0], &f->normalIndices[0],
-					&f->positionIndices[1], &f->texcoordIndices[1], &f->normalIndices[1],
-					&f->positionIndices[2], &f->texcoordIndices[2], &f->normalIndices[2],
-					&f->positionIndices[3], &f->texcoordIndices[3], &f->normalIndices[3]);
-				faces->push_back(f);   
+				int nCorners = nVertices == 4 ? 6 : 3;
+				for(int iCorner = 0; iCorner < nCorners; iCorner++)
+				{
+					const int* v = face[quadCorners[iCorner]];
+					unsigned int slot = (unsigned int)chunk.corners.size() * 4;
+					Corner corner;
+					corner.position = resolveIndex(v[0], chunk.positions.size() / 3, chunk.relativeIndices, slot);
+					corner.texcoord = resolveIndex(v[1], chunk.texcoords.size() / 2, chunk.relativeIndices, slot + 1);
+					corner.normal = resolveIndex(v[2], chunk.normals.size() / 3, chunk.relativeIndices, slot + 2);
+					chunk.corners.push_back(corner);
+				}
 			}
 		}
-		else if((*rows[i])[0] == 'g')
+		else if(p[0] == 'g')
 		{
-			if(faces->size() > 0)
-			{
-				submeshFaces.push_back(std::vector<Face*>());
-				faces = &submeshFaces.at(submeshFaces.size()-1);
-			}
+			chunk.groupStarts.push_back((unsigned int)(chunk.corners.size() / 3));
 		}
+
+		p = skipLine(p, end);
+	}
+}
+
+bool Mesh::loadObj(const char *filename)
+{
+	MappedFile file(filename);
+	if(!file.isOpen())
+	{
+		return false;
 	}
 
-	modelid = glGenLists(submeshFaces.size());
+	// split into line-aligned slices, none smaller than minChunkSize
+	const size_t minChunkSize = 256 * 1024;
+	unsigned int nThreads = loaderThreads != 0 ? loaderThreads : std::thread::hardware_concurrency();
+	size_t nChunks = std::max<size_t>(1, std::min<size_t>(std::max(nThreads, 1u), file.getSize() / minChunkSize));
 
-	for(int iSubmesh=0; iSubmesh<submeshFaces.size(); iSubmesh++)
+	std::vector<const char*> bounds(1, file.begin());
+	for(size_t i = 1; i < nChunks; i++)
 	{
-		std::vector<Face*>& faces = submeshFaces.at(iSubmesh);
+		const char* split = std::max(bounds.back(), file.begin() + file.getSize() * i / nChunks);
+		bounds.push_back(skipLine(split, file.end()));
+	}
+	bounds.push_back(file.end());
 
-		glNewList(modelid + iSubmesh,GL_COMPILE);     
+	std::vector<ObjChunk> chunks(nChunks);
+	std::vector<std::thread> workers;
+	for(size_t i = 1; i < nChunks; i++)
+		workers.push_back(std::thread(parseObjChunk, bounds[i], bounds[i+1], std::ref(chunks[i])));
+	parseObjChunk(bounds[0], bounds[1], chunks[0]);
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
 
-		glBegin(GL_TRIANGLES);
-		for(int i=0;i<faces.size();i++)
+	// concatenate the chunks in file order
+	ObjChunk merged;
+	size_t nPositions = 0, nNormals = 0, nTexcoords = 0, nCorners = 0;
+	for(size_t i = 0; i < nChunks; i++)
+	{
+		nPositions += chunks[i].positions.size();
+		nNormals += chunks[i].normals.size();
+		nTexcoords += chunks[i].texcoords.size();
+		nCorners += chunks[i].corners.size();
+	}
+	merged.positions.reserve(nPositions);
+	merged.normals.reserve(nNormals);
+	merged.texcoords.reserve(nTexcoords);
+	merged.corners.reserve(nCorners);
+
+	Submesh first = { 0, 0 };
+	submeshes.push_back(first);
+	for(size_t i = 0; i < nChunks; i++)
+	{
+		ObjChunk& chunk = chunks[i];
+		int bases[3] = { (int)(merged.positions.size() / 3), (int)(merged.texcoords.size() / 2), (int)(merged.normals.size() / 3) };
+		unsigned int firstTriangle = (unsigned int)(merged.corners.size() / 3);
+
+		for(size_t j = 0; j < chunk.relativeIndices.size(); j++)
+		{
+			unsigned int slot = chunk.relativeIndices[j];
+			int* cornerIndices = &chunk.corners[slot / 4].position;
+			cornerIndices[slot % 4] += bases[slot % 4];
+		}
+
+		// a "g" line only opens a new submesh once the current one has triangles
+		for(size_t j = 0; j < chunk.groupStarts.size(); j++)
 		{
-			//printf("%i\n", normals.size());
-			//printf("%i\n", faces.size());
-			//printf("%i\n", faces[i]->normalIndices[1]);
-			if(faces[i]->isQuad)
+			unsigned int groupStart = firstTriangle + chunk.groupStarts[j];
+			if(groupStart > submeshes.back().firstTriangle)
 			{
-				glNormal3f(normals[faces[i]->normalIndices[0]-1]->x,normals[faces[i]->normalIndices[0]-1]->y,normals[faces[i]->normalIndices[0]-1]->z);
-				glTexCoord2f(texcoords[faces[i]->texcoordIndices[0]-1]->x,1-texcoords[faces[i]->texcoordIndices[0]-1]->y);
-				glVertex3f(positions[faces[i]->positionIndices[0]-1]->x,positions[faces[i]->positionIndices[0]-1]->y,positions[faces[i]->positionIndices[0]-1]->z);
-				glNormal3f(normals[faces[i]->normalIndices[1]-1]->x,normals[faces[i]->normalIndices[1]-1]->y,normals[faces[i]->normalIndices[1]-1]->z);
-				glTexCoord2f(texcoords[faces[i]->texcoordIndices[1]-1]->x,1-texcoords[faces[i]->texcoordIndices[1]-1]->y);
-				glVertex3f(positions[faces[i]->positionIndices[1]-1]->x,positions[faces[i]->positionIndices[1]-1]->y,positions[faces[i]->positionIndices[1]-1]->z);
-				glNormal3f(normals[faces[i]->normalIndices[2]-1]->x,normals[faces[i]->normalIndices[2]-1]->y,normals[faces[i]->normalIndices[2]-1]->z);
-				glTexCoord2f(texcoords[faces[i]->texcoordIndices[2]-1]->x,1-texcoords[faces[i]->texcoordIndices[2]-1]->y);
-				glVertex3f(positions[faces[i]->positionIndices[2]-1]->x,positions[faces[i]->positionIndices[2]-1]->y,positions[faces[i]->positionIndices[2]-1]->z);
-
-				glNormal3f(normals[faces[i]->normalIndices[1]-1]->x,normals[faces[i]->normalIndices[1]-1]->y,normals[faces[i]->normalIndices[1]-1]->z);
-				glTexCoord2f(texcoords[faces[i]->texcoordIndices[1]-1]->x,1-texcoords[faces[i]->texcoordIndices[1]-1]->y);
-				glVertex3f(positions[faces[i]->positionIndices[1]-1]->x,positions[faces[i]->positionIndices[1]-1]->y,positions[faces[i]->positionIndices[1]-1]->z);
-				glNormal3f(normals[faces[i]->normalIndices[2]-1]->x,normals[faces[i]->normalIndices[2]-1]->y,normals[faces[i]->normalIndices[2]-1]->z);
-				glTexCoord2f(texcoords[faces[i]->texcoordIndices[2]-1]->x,1-texcoords[faces[i]->texcoordIndices[2]-1]->y);
-				glVertex3f(positions[faces[i]->positionIndices[2]-1]->x,positions[faces[i]->positionIndices[2]-1]->y,positions[faces[i]->positionIndices[2]-1]->z);
-				glNormal3f(normals[faces[i]->normalIndices[3]-1]->x,normals[faces[i]->normalIndices[3]-1]->y,normals[faces[i]->normalIndices[3]-1]->z);
-				glTexCoord2f(texcoords[faces[i]->texcoordIndices[3]-1]->x,1-texcoords[faces[i]->texcoordIndices[3]-1]->y);
-				glVertex3f(positions[faces[i]->positionIndices[3]-1]->x,positions[faces[i]->positionIndices[3]-1]->y,positions[faces[i]->positionIndices[3]-1]->z);
+				submeshes.back().triangleCount = groupStart - submeshes.back().firstTriangle;
+				Submesh submesh = { groupStart, 0 };
+				submeshes.push_back(submesh);
+			}
+		}
 
+		merged.positions.insert(merged.positions.end(), chunk.positions.begin(), chunk.positions.end());
+		merged.normals.insert(merged.normals.end(), chunk.normals.begin(), chunk.normals.end());
+		merged.texcoords.insert(merged.texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+		merged.corners.insert(merged.corners.end(), chunk.corners.begin(), chunk.corners.end());
+	}
+	submeshes.back().triangleCount = (unsigned int)(merged.corners.size() / 3) - submeshes.back().firstTriangle;
+	lodErrors.assign(1, 0.0f);
+
+	// triangles with an index outside its list, or without a position, are dropped;
+	// the submeshes keep their numbers even if that leaves some of them empty
+	int counts[3] = { (int)(merged.positions.size() / 3), (int)(merged.texcoords.size() / 2), (int)(merged.normals.size() / 3) };
+	unsigned int kept = 0;
+	for(size_t iSubmesh = 0; iSubmesh < submeshes.size(); iSubmesh++)
+	{
+		Submesh& submesh = submeshes[iSubmesh];
+		unsigned int firstKept = kept;
+		for(unsigned int t = submesh.firstTriangle; t < submesh.firstTriangle + submesh.triangleCount; t++)
+		{
+			bool valid = true;
+			for(int iCorner = 0; iCorner < 3; iCorner++)
+			{
+				const Corner& corner = merged.corners[t * 3 + iCorner];
+				valid = valid && corner.position >= 0 && corner.position < counts[0]
+					&& corner.texcoord >= -1 && corner.texcoord < counts[1]
+					&& corner.normal >= -1 && corner.normal < counts[2];
 			}
-			else
+			if(!valid)
+				continue;
+			for(int iCorner = 0; iCorner < 3; iCorner++)
+				merged.corners[kept * 3 + iCorner] = merged.corners[t * 3 + iCorner];
+			kept++;
+		}
+		submesh.firstTriangle = firstKept;
+		submesh.triangleCount = kept - firstKept;
+	}
+	merged.corners.resize(kept * 3);
+
+	weld(merged);
+	return true;
+}
+
+// Welding compares the final vertex values, so corners that reference different
+// but equal texcoords or normals in the .obj still end up sharing one vertex.
+struct  WeldVertex
+{
+	float   values[8];
+
+	bool operator==(const WeldVertex& other) const
+	{
+		return memcmp(values, other.values, sizeof(values)) == 0;
+	}
+};
+
+struct  WeldVertexHash
+{
+	size_t operator()(const WeldVertex& vertex) const
+	{
+		// FNV-1a over the raw bytes
+		const unsigned char* bytes = (const unsigned char*)vertex.values;
+		size_t hash = 2166136261u;
+		for(unsigned int i = 0; i < sizeof(vertex.values); i++)
+			hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+};
+
+void Mesh::weld(const ObjChunk& obj)
+{
+	std::unordered_map<WeldVertex, unsigned int, WeldVertexHash> vertexOf;
+	vertexOf.reserve(obj.corners.size());
+	indices.resize(obj.corners.size());
+	for(unsigned int i = 0; i < obj.corners.size(); i++)
+	{
+		const Corner& corner = obj.corners[i];
+		WeldVertex vertex;
+		memcpy(vertex.values, &obj.positions[corner.position * 3], 3 * sizeof(float));
+		if(corner.normal >= 0)
+			memcpy(vertex.values + 3, &obj.normals[corner.normal * 3], 3 * sizeof(float));
+		else
+		{
+			vertex.values[3] = 0.0f;
+			vertex.values[4] = 1.0f;
+			vertex.values[5] = 0.0f;
+		}
+		if(corner.texcoord >= 0)
+		{
+			vertex.values[6] = obj.texcoords[corner.texcoord * 2];
+			vertex.values[7] = 1 - obj.texcoords[corner.texcoord * 2 + 1];
+		}
+		else
+		{
+			vertex.values[6] = 0.0f;
+			vertex.values[7] = 0.0f;
+		}
+
+		std::pair<std::unordered_map<WeldVertex, unsigned int, WeldVertexHash>::iterator, bool> inserted =
+			vertexOf.insert(std::make_pair(vertex, (unsigned int)(positions.size() / 3)));
+		if(inserted.second)
+		{
+			positions.insert(positions.end(), vertex.values, vertex.values + 3);
+			normals.insert(normals.end(), vertex.values + 3, vertex.values + 6);
+			texcoords.insert(texcoords.end(), vertex.values + 6, vertex.values + 8);
+		}
+		indices[i] = inserted.first->second;
+	}
+}
+
+void Mesh::optimize()
+{
+	size_t vertexCount = positions.size() / 3;
+	if(indices.empty())
+		return;
+
+	// triangles are only reordered inside their submesh
+	for(unsigned int iSubmesh = 0; iSubmesh < submeshes.size(); iSubmesh++)
+	{
+		if(submeshes[iSubmesh].triangleCount != 0)
+			optimizeVertexCache(&indices[submeshes[iSubmesh].firstTriangle * 3], submeshes[iSubmesh].triangleCount * 3, vertexCount);
+	}
+
+	std::vector<unsigned int> remap(vertexCount);
+	size_t usedCount = optimizeVertexFetch(&indices[0], indices.size(), vertexCount, &remap[0]);
+	remapVertexAttribute(&positions[0], vertexCount, 3, &remap[0]);
+	remapVertexAttribute(&normals[0], vertexCount, 3, &remap[0]);
+	remapVertexAttribute(&texcoords[0], vertexCount, 2, &remap[0]);
+	positions.resize(usedCount * 3);
+	normals.resize(usedCount * 3);
+	texcoords.resize(usedCount * 2);
+}
+
+void Mesh::generateLods()
+{
+	// each level aims for this share of the full detail triangle count
+	static const float lodRatios[] = { 0.5f, 0.25f, 0.125f };
+
+	unsigned int submeshCount = (unsigned int)submeshes.size();
+	size_t vertexCount = positions.size() / 3;
+	if(indices.empty())
+		return;
+
+	// a position used by more than one submesh is on a submesh boundary and must not move
+	std::vector<unsigned char> locked(vertexCount, 0);
+	if(submeshCount > 1)
+	{
+		// every vertex stands for the first one at its position, the same way simplifyMesh finds seams
+		std::unordered_map<PositionKey, unsigned int, PositionKeyHash> firstAt;
+		firstAt.reserve(vertexCount);
+		std::vector<unsigned int> positionClass(vertexCount);
+		for(size_t v = 0; v < vertexCount; v++)
+		{
+			PositionKey key;
+			memcpy(key.bits, &positions[v * 3], sizeof(key.bits));
+			positionClass[v] = firstAt.insert(std::make_pair(key, (unsigned int)v)).first->second;
+		}
+
+		// the submesh using each position, shared once a second one does
+		const unsigned int unused = ~0u, shared = ~0u - 1;
+		std::vector<unsigned int> submeshAt(vertexCount, unused);
+		for(unsigned int iSubmesh = 0; iSubmesh < submeshCount; iSubmesh++)
+		{
+			const Submesh& submesh = submeshes[iSubmesh];
+			for(unsigned int i = submesh.firstTriangle * 3; i < (submesh.firstTriangle + submesh.triangleCount) * 3; i++)
 			{
-				glNormal3f(normals[faces[i]->normalIndices[0]-1]->x,normals[faces[i]->normalIndices[0]-1]->y,normals[faces[i]->normalIndices[0]-1]->z);
-				glTexCoord2f(texcoords[faces[i]->texcoordIndices[0]-1]->x,1-texcoords[faces[i]->texcoordIndices[0]-1]->y);
-				glVertex3f(positions[faces[i]->positionIndices[0]-1]->x,positions[faces[i]->positionIndices[0]-1]->y,positions[faces[i]->positionIndices[0]-1]->z);
-				glNormal3f(normals[faces[i]->normalIndices[1]-1]->x,normals[faces[i]->normalIndices[1]-1]->y,normals[faces[i]->normalIndices[1]-1]->z);
-				glTexCoord2f(texcoords[faces[i]->texcoordIndices[1]-1]->x,1-texcoords[faces[i]->texcoordIndices[1]-1]->y);
-				glVertex3f(positions[faces[i]->positionIndices[1]-1]->x,positions[faces[i]->positionIndices[1]-1]->y,positions[faces[i]->positionIndices[1]-1]->z);
-				glNormal3f(normals[faces[i]->normalIndices[2]-1]->x,normals[faces[i]->normalIndices[2]-1]->y,normals[faces[i]->normalIndices[2]-1]->z);
-				glTexCoord2f(texcoords[faces[i]->texcoordIndices[2]-1]->x,1-texcoords[faces[i]->texcoordIndices[2]-1]->y);
-				glVertex3f(positions[faces[i]->positionIndices[2]-1]->x,positions[faces[i]->positionIndices[2]-1]->y,positions[faces[i]->positionIndices[2]-1]->z);
+				unsigned int& at = submeshAt[positionClass[indices[i]]];
+				if(at == unused)
+					at = iSubmesh;
+				else if(at != iSubmesh)
+					at = shared;
 			}
 		}
+		for(size_t v = 0; v < vertexCount; v++)
+			locked[v] = submeshAt[positionClass[v]] == shared;
+	}
+
+	size_t fullCount = indices.size() / 3;
+	for(unsigned int iLevel = 0; iLevel < sizeof(lodRatios) / sizeof(lodRatios[0]); iLevel++)
+	{
+		const Submesh* previous = &submeshes[submeshes.size() - submeshCount];
+		size_t previousCount = 0;
+		float levelError = lodErrors.back();
+		std::vector<Submesh> level(submeshCount);
+		std::vector<unsigned int> levelIndices;
+		for(unsigned int iSubmesh = 0; iSubmesh < submeshCount; iSubmesh++)
+		{
+			const Submesh& source = previous[iSubmesh];
+			const Submesh& full = submeshes[iSubmesh];
+			previousCount += source.triangleCount;
+
+			std::vector<unsigned int> simplified(source.triangleCount * 3);
+			float error = 0.0f;
+			size_t target = (size_t)(full.triangleCount * lodRatios[iLevel]) * 3;
+			size_t count = source.triangleCount ? simplifyMesh(&simplified[0], &indices[source.firstTriangle * 3], source.triangleCount * 3,
+				&positions[0], vertexCount, &locked[0], target, error) : 0;
+			if(count)
+				optimizeVertexCache(&simplified[0], count, vertexCount);
+
+			level[iSubmesh].firstTriangle = (unsigned int)((indices.size() + levelIndices.size()) / 3);
+			level[iSubmesh].triangleCount = (unsigned int)(count / 3);
+			levelIndices.insert(levelIndices.end(), simplified.begin(), simplified.begin() + count);
+			levelError = std::max(levelError, error);
+		}
+
+		// stop once a level no longer saves a meaningful amount of triangles
+		if(levelIndices.size() / 3 > previousCount * 9 / 10 || levelIndices.size() / 3 > fullCount)
+			break;
+
+		indices.insert(indices.end(), levelIndices.begin(), levelIndices.end());
+		submeshes.insert(submeshes.end(), level.begin(), level.end());
+		lodErrors.push_back(levelError);
+	}
+}
+
+void Mesh::quantize()
+{
+	size_t count = positions.size() / 3;
+
+	// 16 bit positions spread over the bounding box
+	float minimum[3] = { 0, 0, 0 }, maximum[3] = { 0, 0, 0 };
+	for(size_t v = 0; v < count; v++)
+		for(int k = 0; k < 3; k++)
+		{
+			float value = positions[v * 3 + k];
+			minimum[k] = (v == 0 || value < minimum[k]) ? value : minimum[k];
+			maximum[k] = (v == 0 || value > maximum[k]) ? value : maximum[k];
+		}
+	float largest = std::max(maximum[0] - minimum[0], std::max(maximum[1] - minimum[1], maximum[2] - minimum[2]));
+	float offset[3], scale[3];
+	for(int k = 0; k < 3; k++)
+	{
+		offset[k] = (minimum[k] + maximum[k]) * 0.5f;
+		// flat axes still need a usable scale, the matrix has to stay invertible for lighting
+		scale[k] = std::max(std::max((maximum[k] - minimum[k]) * 0.5f, largest * 1e-4f), 1e-6f) / 32767.0f;
+	}
+	setDequantization(offset, scale);
+
+	quantizedPositions.resize(count * 3);
+	for(size_t i = 0; i < count * 3; i++)
+	{
+		float q = floorf((positions[i] - offset[i % 3]) / scale[i % 3] + 0.5f);
+		quantizedPositions[i] = (int16_t)std::max(-32767.0f, std::min(32767.0f, q));
+	}
+
+	octNormals.clear();
+	octNormalsLow.clear();
+	halfTexcoords.resize(count * 2);
+	for(size_t v = 0; v < count; v++)
+	{
+		float octahedral[2];
+		encodeOctahedral(&normals[v * 3], octahedral);
+		for(int k = 0; k < 2; k++)
+		{
+			if(vertexFormat == VERTEX_FORMAT_COMPACT_LOW)
+				octNormalsLow.push_back((int8_t)quantizeSnorm(octahedral[k], 8));
+			else
+				octNormals.push_back((int16_t)quantizeSnorm(octahedral[k], 16));
+			halfTexcoords[v * 2 + k] = floatToHalf(texcoords[v * 2 + k]);
+		}
+	}
+
+	std::vector<float>().swap(positions);
+	std::vector<float>().swap(normals);
+	std::vector<float>().swap(texcoords);
+}
+
+void Mesh::setDequantization(const float *offset, const float *scale)
+{
+	memset(dequantization, 0, sizeof(dequantization));
+	for(int k = 0; k < 3; k++)
+	{
+		dequantization[k * 5] = scale ? scale[k] : 1.0f;
+		dequantization[12 + k] = offset ? offset[k] : 0.0f;
+	}
+	dequantization[15] = 1.0f;
+}
+
+void Mesh::decodeVertex(unsigned int vertex, float *position, float *normal, float *texcoord) const
+{
+	if(vertexFormat == VERTEX_FORMAT_FLOAT)
+	{
+		memcpy(position, &positions[vertex * 3], 3 * sizeof(float));
+		memcpy(normal, &normals[vertex * 3], 3 * sizeof(float));
+		memcpy(texcoord, &texcoords[vertex * 2], 2 * sizeof(float));
+		return;
+	}
+
+	float octahedral[2];
+	for(int k = 0; k < 3; k++)
+		position[k] = dequantization[12 + k] + dequantization[k * 5] * quantizedPositions[vertex * 3 + k];
+	for(int k = 0; k < 2; k++)
+	{
+		if(vertexFormat == VERTEX_FORMAT_COMPACT_LOW)
+			octahedral[k] = dequantizeSnorm(octNormalsLow[vertex * 2 + k], 8);
+		else
+			octahedral[k] = dequantizeSnorm(octNormals[vertex * 2 + k], 16);
+		texcoord[k] = halfToFloat(halfTexcoords[vertex * 2 + k]);
+	}
+	decodeOctahedral(octahedral, normal);
+}
+
+size_t Mesh::getStoredVertexCount() const
+{
+	return (vertexFormat == VERTEX_FORMAT_FLOAT ? positions.size() : quantizedPositions.size()) / 3;
+}
+
+// box and sphere around the vertices marked in used (all of them when used is NULL)
+static Mesh::Bounds boundVertices(const std::vector<float3>& vertices, const std::vector<unsigned char>* used)
+{
+	Mesh::Bounds bounds;
+	bounds.minimum = bounds.maximum = bounds.center = float3(0, 0, 0);
+	bounds.radius = 0.0f;
+
+	bool first = true;
+	for(size_t v = 0; v < vertices.size(); v++)
+	{
+		if(used && !(*used)[v])
+			continue;
+		const float3& p = vertices[v];
+		if(first)
+		{
+			bounds.minimum = bounds.maximum = p;
+			first = false;
+			continue;
+		}
+		bounds.minimum = float3(std::min(bounds.minimum.x, p.x), std::min(bounds.minimum.y, p.y), std::min(bounds.minimum.z, p.z));
+		bounds.maximum = float3(std::max(bounds.maximum.x, p.x), std::max(bounds.maximum.y, p.y), std::max(bounds.maximum.z, p.z));
+	}
+
+	bounds.center = (bounds.minimum + bounds.maximum) * 0.5f;
+	float radius2 = 0.0f;
+	for(size_t v = 0; v < vertices.size(); v++)
+		if(!used || (*used)[v])
+			radius2 = std::max(radius2, (vertices[v] - bounds.center).norm2());
+	bounds.radius = sqrtf(radius2);
+	return bounds;
+}
+
+void Mesh::computeBounds()
+{
+	// bound what gets drawn, after quantization
+	size_t count = getStoredVertexCount();
+	std::vector<float3> decoded(count);
+	for(size_t v = 0; v < count; v++)
+	{
+		float position[3], normal[3], texcoord[2];
+		decodeVertex((unsigned int)v, position, normal, texcoord);
+		decoded[v] = float3(position[0], position[1], position[2]);
+	}
+	bounds = boundVertices(decoded, NULL);
+
+	// coarser levels only use a subset of the full detail vertices
+	unsigned int submeshCount = getLevelSubmeshCount();
+	submeshBounds.resize(submeshCount);
+	std::vector<unsigned char> used(count);
+	for(unsigned int iSubmesh = 0; iSubmesh < submeshCount; iSubmesh++)
+	{
+		const Submesh& submesh = submeshes[iSubmesh];
+		std::fill(used.begin(), used.end(), 0);
+		for(unsigned int i = submesh.firstTriangle * 3; i < (submesh.firstTriangle + submesh.triangleCount) * 3; i++)
+			used[indices[i]] = 1;
+		submeshBounds[iSubmesh] = boundVertices(decoded, &used);
+	}
+}
+
+Mesh::Bounds Mesh::Bounds::transform(const float4x4& m) const
+{
+	// the box center moves with the matrix, the half extents grow by the absolute
+	// value of each axis so a rotated box still fits
+	float3 halfExtent = (maximum - minimum) * 0.5f;
+	float4 boxCenter = float4((minimum + maximum) * 0.5f) * m;
+	float3 worldHalfExtent(
+		fabsf(m._00) * halfExtent.x + fabsf(m._10) * halfExtent.y + fabsf(m._20) * halfExtent.z,
+		fabsf(m._01) * halfExtent.x + fabsf(m._11) * halfExtent.y + fabsf(m._21) * halfExtent.z,
+		fabsf(m._02) * halfExtent.x + fabsf(m._12) * halfExtent.y + fabsf(m._22) * halfExtent.z);
+
+	// the sphere scales with the longest transformed axis
+	float scale2 = std::max(m._00 * m._00 + m._01 * m._01 + m._02 * m._02,
+		std::max(m._10 * m._10 + m._11 * m._11 + m._12 * m._12, m._20 * m._20 + m._21 * m._21 + m._22 * m._22));
+	float4 sphereCenter = float4(center) * m;
+
+	Bounds result;
+	result.minimum = float3(boxCenter.x, boxCenter.y, boxCenter.z) - worldHalfExtent;
+	result.maximum = float3(boxCenter.x, boxCenter.y, boxCenter.z) + worldHalfExtent;
+	result.center = float3(sphereCenter.x, sphereCenter.y, sphereCenter.z);
+	result.radius = radius * sqrtf(scale2);
+	return result;
+}
+
+// bytes one vertex takes in memory and in the cache
+static size_t storedVertexSize(int vertexFormat)
+{
+	if(vertexFormat == Mesh::VERTEX_FORMAT_COMPACT)
+		return 3 * sizeof(int16_t) + 2 * sizeof(int16_t) + 2 * sizeof(uint16_t);
+	if(vertexFormat == Mesh::VERTEX_FORMAT_COMPACT_LOW)
+		return 3 * sizeof(int16_t) + 2 * sizeof(int8_t) + 2 * sizeof(uint16_t);
+	return Mesh::VERTEX_FLOATS * sizeof(float);
+}
+
+bool Mesh::loadCache(const char *cachePath, uint64_t sourceSize, int64_t sourceTime)
+{
+	MappedFile file(cachePath);
+	if(!file.isOpen() || file.getSize() < sizeof(MeshCacheHeader))
+		return false;
+
+	// a cache written in another vertex format is rebuilt rather than converted
+	const MeshCacheHeader* header = (const MeshCacheHeader*)file.begin();
+	if(memcmp(header->magic, "DTMS", 4) != 0 || header->version != MESH_CACHE_VERSION
+		|| header->sourceSize != sourceSize || header->sourceTime != sourceTime
+		|| header->vertexFormat != (uint32_t)vertexFormat)
+		return false;
+
+	// no count may claim more than the file holds, then none of the sizes below can wrap
+	size_t fileSize = file.getSize();
+	if(header->lodCount == 0 || header->submeshCount == 0
+		|| header->submeshCount > fileSize / sizeof(MeshCacheBounds)
+		|| header->lodCount > fileSize / sizeof(MeshCacheSubmesh) / header->submeshCount
+		|| header->vertexCount > fileSize / storedVertexSize(vertexFormat)
+		|| header->triangleCount > fileSize / (3 * sizeof(uint32_t)))
+		return false;
+
+	bool compact = vertexFormat != VERTEX_FORMAT_FLOAT;
+	size_t vertexBytes = (size_t)header->vertexCount * storedVertexSize(vertexFormat);
+	size_t submeshCount = (size_t)header->lodCount * header->submeshCount;
+	size_t indexCount = (size_t)header->triangleCount * 3;
+	size_t expectedSize = sizeof(MeshCacheHeader)
+		+ submeshCount * sizeof(MeshCacheSubmesh)
+		+ (size_t)header->lodCount * sizeof(float)
+		+ (1 + (size_t)header->submeshCount) * sizeof(MeshCacheBounds)
+		+ (compact ? 6 * sizeof(float) : 0)
+		+ ((vertexBytes + 3) & ~(size_t)3)
+		+ indexCount * sizeof(uint32_t);
+	if(fileSize != expectedSize)
+		return false;
+
+	size_t n = header->vertexCount;
+	const MeshCacheSubmesh* submeshTable = (const MeshCacheSubmesh*)(header + 1);
+	const float* lodErrorData = (const float*)(submeshTable + header->lodCount * header->submeshCount);
+	const MeshCacheBounds* boundsTable = (const MeshCacheBounds*)(lodErrorData + header->lodCount);
+	const char* vertexData = (const char*)(boundsTable + 1 + header->submeshCount);
+
+	// submeshes follow each other inside the index list, and every index names a vertex;
+	// a cache that says otherwise is rebuilt from the .obj
+	const uint32_t* indexData = (const uint32_t*)(vertexData + (compact ? 6 * sizeof(float) : 0) + ((vertexBytes + 3) & ~(size_t)3));
+	uint64_t submeshEnd = 0;
+	for(size_t iSubmesh = 0; iSubmesh < submeshCount; iSubmesh++)
+	{
+		const MeshCacheSubmesh& submesh = submeshTable[iSubmesh];
+		if(submesh.firstTriangle < submeshEnd || (uint64_t)submesh.firstTriangle + submesh.triangleCount > header->triangleCount)
+			return false;
+		submeshEnd = (uint64_t)submesh.firstTriangle + submesh.triangleCount;
+	}
+	for(size_t i = 0; i < indexCount; i++)
+	{
+		if(indexData[i] >= header->vertexCount)
+			return false;
+	}
+
+	if(compact)
+	{
+		const float* quantization = (const float*)vertexData;
+		setDequantization(quantization, quantization + 3);
+
+		const int16_t* positionData = (const int16_t*)(quantization + 6);
+		quantizedPositions.assign(positionData, positionData + n * 3);
+		const char* normalData = (const char*)(positionData + n * 3);
+		const uint16_t* texcoordData;
+		if(vertexFormat == VERTEX_FORMAT_COMPACT_LOW)
+		{
+			octNormalsLow.assign((const int8_t*)normalData, (const int8_t*)normalData + n * 2);
+			texcoordData = (const uint16_t*)(normalData + n * 2 * sizeof(int8_t));
+		}
+		else
+		{
+			octNormals.assign((const int16_t*)normalData, (const int16_t*)normalData + n * 2);
+			texcoordData = (const uint16_t*)(normalData + n * 2 * sizeof(int16_t));
+		}
+		halfTexcoords.assign(texcoordData, texcoordData + n * 2);
+		vertexData = (const char*)(quantization + 6);
+	}
+	else
+	{
+		const float* positionData = (const float*)vertexData;
+		const float* normalData = positionData + n * 3;
+		const float* texcoordData = normalData + n * 3;
+		positions.assign(positionData, positionData + n * 3);
+		normals.assign(normalData, normalData + n * 3);
+		texcoords.assign(texcoordData, texcoordData + n * 2);
+	}
+	indices.assign(indexData, indexData + indexCount);
+
+	lodErrors.assign(lodErrorData, lodErrorData + header->lodCount);
+	submeshes.resize(submeshCount);
+	for(size_t iSubmesh = 0; iSubmesh < submeshes.size(); iSubmesh++)
+	{
+		submeshes[iSubmesh].firstTriangle = submeshTable[iSubmesh].firstTriangle;
+		submeshes[iSubmesh].triangleCount = submeshTable[iSubmesh].triangleCount;
+	}
+
+	submeshBounds.resize(header->submeshCount);
+	for(uint32_t i = 0; i <= header->submeshCount; i++)
+	{
+		const MeshCacheBounds& stored = boundsTable[i];
+		Bounds& loaded = i == 0 ? bounds : submeshBounds[i - 1];
+		loaded.minimum = float3(stored.minimum[0], stored.minimum[1], stored.minimum[2]);
+		loaded.maximum = float3(stored.maximum[0], stored.maximum[1], stored.maximum[2]);
+		loaded.center = float3(stored.center[0], stored.center[1], stored.center[2]);
+		loaded.radius = stored.radius;
+	}
+	return true;
+}
+
+// fwrite of a whole vector, empty ones count as written
+template<class T>
+static bool writeArray(const std::vector<T>& values, FILE* file)
+{
+	return values.empty() || fwrite(&values[0], sizeof(T), values.size(), file) == values.size();
+}
+
+void Mesh::saveCache(const char *cachePath, uint64_t sourceSize, int64_t sourceTime)
+{
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "DTMS", 4);
+	header.version = MESH_CACHE_VERSION;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	header.vertexCount = (uint32_t)getStoredVertexCount();
+	header.triangleCount = (uint32_t)(indices.size() / 3);
+	header.submeshCount = (uint32_t)getLevelSubmeshCount();
+	header.lodCount = (uint32_t)lodErrors.size();
+	header.vertexFormat = (uint32_t)vertexFormat;
+
+	std::vector<MeshCacheSubmesh> submeshTable(submeshes.size());
+	for(unsigned int iSubmesh = 0; iSubmesh < submeshes.size(); iSubmesh++)
+	{
+		submeshTable[iSubmesh].firstTriangle = submeshes[iSubmesh].firstTriangle;
+		submeshTable[iSubmesh].triangleCount = submeshes[iSubmesh].triangleCount;
+	}
+
+	std::vector<MeshCacheBounds> boundsTable(1 + submeshBounds.size());
+	for(size_t i = 0; i < boundsTable.size(); i++)
+	{
+		const Bounds& source = i == 0 ? bounds : submeshBounds[i - 1];
+		MeshCacheBounds& stored = boundsTable[i];
+		stored.minimum[0] = source.minimum.x; stored.minimum[1] = source.minimum.y; stored.minimum[2] = source.minimum.z;
+		stored.maximum[0] = source.maximum.x; stored.maximum[1] = source.maximum.y; stored.maximum[2] = source.maximum.z;
+		stored.center[0] = source.center.x; stored.center[1] = source.center.y; stored.center[2] = source.center.z;
+		stored.radius = source.radius;
+	}
+
+	// write next to the final name and swap it in, so a crash never leaves a half written cache behind
+	std::string tmpPath = std::string(cachePath) + ".tmp";
+	FILE* file = fopen(tmpPath.c_str(), "wb");
+	if(file == NULL)
+		return;
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && writeArray(submeshTable, file);
+	ok = ok && writeArray(lodErrors, file);
+	ok = ok && writeArray(boundsTable, file);
+	if(vertexFormat != VERTEX_FORMAT_FLOAT)
+	{
+		float quantization[6] = { dequantization[12], dequantization[13], dequantization[14], dequantization[0], dequantization[5], dequantization[10] };
+		ok = ok && fwrite(quantization, sizeof(float), 6, file) == 6;
+		ok = ok && writeArray(quantizedPositions, file);
+		ok = ok && writeArray(octNormals, file);
+		ok = ok && writeArray(octNormalsLow, file);
+		ok = ok && writeArray(halfTexcoords, file);
+
+		// keep the indices 4 byte aligned
+		static const char padding[4] = { 0, 0, 0, 0 };
+		size_t paddingSize = (4 - header.vertexCount * storedVertexSize(vertexFormat) % 4) % 4;
+		ok = ok && fwrite(padding, 1, paddingSize, file) == paddingSize;
+	}
+	else
+	{
+		ok = ok && writeArray(positions, file);
+		ok = ok && writeArray(normals, file);
+		ok = ok && writeArray(texcoords, file);
+	}
+	ok = ok && writeArray(indices, file);
+	ok = (fclose(file) == 0) && ok;
+
+	remove(cachePath);
+	if(!ok || rename(tmpPath.c_str(), cachePath) != 0)
+		remove(tmpPath.c_str());
+}
+
+void Mesh::buildDisplayLists()
+{
+	modelid = glGenLists(submeshes.size());
+
+	for(unsigned int iSubmesh=0; iSubmesh<submeshes.size(); iSubmesh++)
+	{
+		const Submesh& submesh = submeshes[iSubmesh];
+
+		glNewList(modelid + iSubmesh,GL_COMPILE);
+
+		glBegin(GL_TRIANGLES);
+		for(unsigned int i = submesh.firstTriangle * 3; i < (submesh.firstTriangle + submesh.triangleCount) * 3; i++)
+		{
+			float position[3], normal[3], texcoord[2];
+			decodeVertex(indices[i], position, normal, texcoord);
+			glNormal3fv(normal);
+			glTexCoord2fv(texcoord);
+			glVertex3fv(position);
+		}
 		glEnd();
 
 		glEndList();
+		// the driver keeps at least the floats of every corner
+		residentBytes += (size_t)submesh.triangleCount * 3 * VERTEX_FLOATS * sizeof(float);
+	}
+}
+
+// GPU side compact vertex: the fixed function pipeline cannot unpack octahedral normals,
+// so they go up as snorm8 xyz, and texcoords fall back to floats without half float support
+struct  CompactVertex
+{
+	int16_t     position[4];
+	int8_t      normal[4];
+	union
+	{
+		uint16_t    half[2];
+		float       full[2];
+	}           texcoord;
+};
+
+// interleaves the vertices and narrows the indices, only the bufferData calls are left for uploadBuffers
+void Mesh::packBuffers()
+{
+	vertexCount = (unsigned int)getStoredVertexCount();
+	if(vertexFormat == VERTEX_FORMAT_FLOAT)
+	{
+		uploadVertices.resize(vertexCount * VERTEX_FLOATS * sizeof(float));
+		for(unsigned int v = 0; v < vertexCount; v++)
+		{
+			float* vertex = (float*)&uploadVertices[v * VERTEX_FLOATS * sizeof(float)];
+			memcpy(vertex, &positions[v * 3], 3 * sizeof(float));
+			memcpy(vertex + 3, &normals[v * 3], 3 * sizeof(float));
+			memcpy(vertex + 6, &texcoords[v * 2], 2 * sizeof(float));
+		}
+	}
+	else
+	{
+		size_t stride = GLExtensions::halfFloatVertex ? offsetof(CompactVertex, texcoord) + 2 * sizeof(uint16_t) : sizeof(CompactVertex);
+		std::vector<char>& vertices = uploadVertices;
+		vertices.resize(vertexCount * stride);
+		for(unsigned int v = 0; v < vertexCount; v++)
+		{
+			CompactVertex vertex;
+			float position[3], normal[3], texcoord[2];
+			decodeVertex(v, position, normal, texcoord);
+
+			// the dequantization scale also reaches the normals through the inverse
+			// transpose, so they are pre-scaled and GL_NORMALIZE restores the length
+			float scaled[3], length = 0.0f;
+			for(int k = 0; k < 3; k++)
+			{
+				scaled[k] = normal[k] * dequantization[k * 5];
+				length += scaled[k] * scaled[k];
+			}
+			length = length > 0.0f ? sqrtf(length) : 1.0f;
+			for(int k = 0; k < 3; k++)
+			{
+				vertex.position[k] = quantizedPositions[v * 3 + k];
+				vertex.normal[k] = (int8_t)quantizeSnorm(scaled[k] / length, 8);
+			}
+			vertex.position[3] = 0;
+			vertex.normal[3] = 0;
+			for(int k = 0; k < 2; k++)
+			{
+				if(GLExtensions::halfFloatVertex)
+					vertex.texcoord.half[k] = halfTexcoords[v * 2 + k];
+				else
+					vertex.texcoord.full[k] = texcoord[k];
+			}
+			memcpy(&vertices[v * stride], &vertex, stride);
+		}
+	}
+
+	if(vertexCount <= 0xFFFF)
+	{
+		indexType = GL_UNSIGNED_SHORT;
+		uploadIndices.resize(indices.size() * sizeof(unsigned short));
+		unsigned short* shortIndices = (unsigned short*)(uploadIndices.empty() ? 0 : &uploadIndices[0]);
+		for(size_t i = 0; i < indices.size(); i++)
+			shortIndices[i] = (unsigned short)indices[i];
+	}
+	else
+	{
+		indexType = GL_UNSIGNED_INT;
+		uploadIndices.resize(indices.size() * sizeof(unsigned int));
+		if(!indices.empty())
+			memcpy(&uploadIndices[0], &indices[0], uploadIndices.size());
+	}
+}
+
+void Mesh::uploadBuffers()
+{
+	GLExtensions::genBuffers(1, &vertexBuffer);
+	GLExtensions::bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	GLExtensions::bufferData(GL_ARRAY_BUFFER, uploadVertices.size(), uploadVertices.empty() ? 0 : &uploadVertices[0], GL_STATIC_DRAW);
+	GLExtensions::bindBuffer(GL_ARRAY_BUFFER, 0);
+
+	GLExtensions::genBuffers(1, &indexBuffer);
+	GLExtensions::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	GLExtensions::bufferData(GL_ELEMENT_ARRAY_BUFFER, uploadIndices.size(), uploadIndices.empty() ? 0 : &uploadIndices[0], GL_STATIC_DRAW);
+	GLExtensions::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	residentBytes = uploadVertices.size() + uploadIndices.size();
+
+	std::vector<char>().swap(uploadVertices);
+	std::vector<char>().swap(uploadIndices);
+}
+
+// binds the buffers and points the fixed function arrays into them
+void Mesh::bindBuffers()
+{
+	GLExtensions::bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	GLExtensions::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	if(vertexFormat == VERTEX_FORMAT_FLOAT)
+	{
+		const GLsizei stride = VERTEX_FLOATS * sizeof(float);
+		glVertexPointer(3, GL_FLOAT, stride, (const void*)0);
+		glNormalPointer(GL_FLOAT, stride, (const void*)(3 * sizeof(float)));
+		glTexCoordPointer(2, GL_FLOAT, stride, (const void*)(6 * sizeof(float)));
+	}
+	else
+	{
+		const GLsizei stride = GLExtensions::halfFloatVertex ? offsetof(CompactVertex, texcoord) + 2 * sizeof(uint16_t) : sizeof(CompactVertex);
+		glVertexPointer(3, GL_SHORT, stride, (const void*)offsetof(CompactVertex, position));
+		glNormalPointer(GL_BYTE, stride, (const void*)offsetof(CompactVertex, normal));
+		glTexCoordPointer(2, GLExtensions::halfFloatVertex ? GL_HALF_FLOAT : GL_FLOAT, stride, (const void*)offsetof(CompactVertex, texcoord));
+	}
+}
+
+void Mesh::unbindBuffers()
+{
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	GLExtensions::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	GLExtensions::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::drawTriangles(unsigned int firstTriangle, unsigned int triangleCount)
+{
+	if(vertexBuffer == 0)
+		return;
+
+	bindBuffers();
+	if(vertexFormat != VERTEX_FORMAT_FLOAT)
+	{
+		// positions are stored relative to the bounding box
+		glPushMatrix();
+		glMultMatrixf(dequantization);
 	}
+
+	size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	glDrawElements(GL_TRIANGLES, triangleCount * 3, indexType, (const void*)(firstTriangle * 3 * indexSize));
+	trianglesSubmitted += triangleCount;
+
+	if(vertexFormat != VERTEX_FORMAT_FLOAT)
+		glPopMatrix();
+	unbindBuffers();
+}
+
+bool Mesh::lodEnabled = true;
+unsigned int Mesh::trianglesSubmitted = 0;
+
+void Mesh::setLodEnabled(bool enabled)
+{
+	lodEnabled = enabled;
+}
+
+bool Mesh::isLodEnabled()
+{
+	return lodEnabled;
+}
+
+unsigned int Mesh::getTrianglesSubmitted()
+{
+	return trianglesSubmitted;
+}
+
+void Mesh::resetTrianglesSubmitted()
+{
+	trianglesSubmitted = 0;
+}
+
+unsigned int Mesh::getSubmeshCount() const
+{
+	return !isLoaded() ? 0 : getLevelSubmeshCount();
+}
+
+unsigned int Mesh::getLevelSubmeshCount() const
+{
+	return lodErrors.empty() ? 0 : (unsigned int)(submeshes.size() / lodErrors.size());
+}
+
+unsigned int Mesh::getLodCount() const
+{
+	return isLoaded() ? (unsigned int)lodErrors.size() : 0;
+}
+
+unsigned int Mesh::selectLod(float screenPerUnit) const
+{
+	// simplification may move the surface by at most this share of the view height,
+	// about 3 pixels in the default 600 pixel window
+	const float maxScreenError = 1.0f / 200.0f;
+
+	unsigned int lod = 0;
+	if(lodEnabled && isLoaded())
+		while(lod + 1 < lodErrors.size() && lodErrors[lod + 1] * screenPerUnit < maxScreenError)
+			lod++;
+	return lod;
 }
 
 void Mesh::draw()
 {
-	for(int iSubmesh=0; iSubmesh<submeshFaces.size(); iSubmesh++)
-		glCallList(modelid + iSubmesh);
+	drawLod(0);
+}
+
+// solid bounding box, stands in for the mesh until its upload is done
+void Mesh::drawPlaceholder()
+{
+	if(!isLoaded() || submeshes.empty())
+		return;
+
+	static const int faces[6][6] = {
+		// axis of the normal, its sign, then the corners as bits x=1 y=2 z=4
+		{ 0, -1, 0, 4, 6, 2 }, { 0, 1, 1, 3, 7, 5 },
+		{ 1, -1, 0, 1, 5, 4 }, { 1, 1, 2, 6, 7, 3 },
+		{ 2, -1, 0, 2, 3, 1 }, { 2, 1, 4, 5, 7, 6 },
+	};
+	glBegin(GL_QUADS);
+	for(int f = 0; f < 6; f++)
+	{
+		float normal[3] = { 0, 0, 0 };
+		normal[faces[f][0]] = (float)faces[f][1];
+		glNormal3fv(normal);
+		for(int c = 2; c < 6; c++)
+		{
+			int corner = faces[f][c];
+			glVertex3f(corner & 1 ? bounds.maximum.x : bounds.minimum.x,
+				corner & 2 ? bounds.maximum.y : bounds.minimum.y,
+				corner & 4 ? bounds.maximum.z : bounds.minimum.z);
+		}
+	}
+	glEnd();
+}
+
+void Mesh::drawLod(unsigned int lod)
+{
+	if(!isReady())
+	{
+		drawPlaceholder();
+		return;
+	}
+
+	unsigned int submeshCount = getSubmeshCount();
+	if(lod >= lodErrors.size() || submeshCount == 0)
+		return;
+	markUsed();
+
+	if(vertexBuffer != 0)
+	{
+		unsigned int firstTriangle, triangleCount;
+		getLevelRange(lod, firstTriangle, triangleCount);
+		drawTriangles(firstTriangle, triangleCount);
+		return;
+	}
+	for(unsigned int iSubmesh=0; iSubmesh<submeshCount; iSubmesh++)
+	{
+		glCallList(modelid + lod * submeshCount + iSubmesh);
+		trianglesSubmitted += submeshes[lod * submeshCount + iSubmesh].triangleCount;
+	}
+}
+
+// the submeshes of a level are stored back to back, so the whole level is a single range
+void Mesh::getLevelRange(unsigned int lod, unsigned int& firstTriangle, unsigned int& triangleCount) const
+{
+	unsigned int submeshCount = getSubmeshCount();
+	const Submesh& first = submeshes[lod * submeshCount];
+	const Submesh& last = submeshes[lod * submeshCount + submeshCount - 1];
+	firstTriangle = first.firstTriangle;
+	triangleCount = last.firstTriangle + last.triangleCount - first.firstTriangle;
+}
+
+bool Mesh::canDrawInstanced() const
+{
+	return GLExtensions::instancedDrawing && isReady() && vertexBuffer != 0;
+}
+
+const float* Mesh::getDequantization() const
+{
+	return dequantization;
+}
+
+// the instance attributes are set up by the caller, the positions are not dequantized here
+void Mesh::drawLodInstanced(unsigned int lod, unsigned int instanceCount)
+{
+	if(!canDrawInstanced() || lod >= lodErrors.size() || getSubmeshCount() == 0 || instanceCount == 0)
+		return;
+	markUsed();
+
+	unsigned int firstTriangle, triangleCount;
+	getLevelRange(lod, firstTriangle, triangleCount);
+	bindBuffers();
+	size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	GLExtensions::drawElementsInstanced(GL_TRIANGLES, triangleCount * 3, indexType, (const void*)(firstTriangle * 3 * indexSize), instanceCount);
+	trianglesSubmitted += triangleCount * instanceCount;
+	unbindBuffers();
 }
 
 void Mesh::drawSubmesh(unsigned int iSubmesh)
 {
+	if(!isReady())
+	{
+		drawPlaceholder();
+		return;
+	}
+	markUsed();
+	if(vertexBuffer != 0)
+	{
+		drawTriangles(submeshes.at(iSubmesh).firstTriangle, submeshes.at(iSubmesh).triangleCount);
+		return;
+	}
 	glCallList(modelid + iSubmesh);
+	trianglesSubmitted += submeshes.at(iSubmesh).triangleCount;
+}
+
+const Mesh::Bounds& Mesh::getBounds() const
+{
+	static const Bounds empty = { float3(0, 0, 0), float3(0, 0, 0), float3(0, 0, 0), 0.0f };
+	return isLoaded() ? bounds : empty;
+}
+
+const Mesh::Bounds& Mesh::getSubmeshBounds(unsigned int iSubmesh) const
+{
+	return submeshBounds.at(iSubmesh);
+}
+
+size_t Mesh::getResidentBytes() const
+{
+	return residentBytes;
 }
 
 Mesh::~Mesh()
 {
-	for(unsigned int i = 0; i < rows.size(); i++)
-		delete rows[i];   
-	for(unsigned int i = 0; i < positions.size(); i++)
-		delete positions[i];
-	for(unsigned int i = 0; i < submeshFaces.size(); i++)
-		for(unsigned int j = 0; j < submeshFaces.at(i).size(); j++)
-			delete submeshFaces.at(i).at(j); 
-	for(unsigned int i = 0; i < normals.size(); i++)
-		delete normals[i];
-	for(unsigned int i = 0; i < texcoords.size(); i++)
-		delete texcoords[i];
+	AssetLoader::cancel(this);
+	if(!isReady() || !GLState::hasContext())
+		return;
+
+	if(vertexBuffer != 0)
+	{
+		GLExtensions::deleteBuffers(1, &vertexBuffer);
+		GLExtensions::deleteBuffers(1, &indexBuffer);
+	}
+	else if(!submeshes.empty())
+		glDeleteLists(modelid, submeshes.size());
 }
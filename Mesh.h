@@ -1,31 +1,171 @@
 #pragma once
-#include "float2.h"
-#include "float3.h"
+#include <stdint.h>
+#include <string>
 #include <vector>
+#include "AssetLoader.h"
+#include "MeshOptimizer.h"
+#include "Residency.h"
+#include "float3.h"
+#include "float4x4.h"
 
-class   Mesh
+class   Mesh : public AsyncAsset, public Resident
 {
-	struct  Face
+public:
+	// axis aligned box and a sphere around its center
+	struct  Bounds
 	{
-		int       positionIndices[4];
-		int       normalIndices[4];
-		int       texcoordIndices[4];
-		bool      isQuad;
+		float3    minimum;
+		float3    maximum;
+		float3    center;
+		float     radius;
+
+		// bounds of the transformed volume (row vector matrix as in float4x4)
+		Bounds    transform(const float4x4& m) const;
 	};
 
-	std::vector<std::string*>	rows;
-	std::vector<float3*>		positions;
-	std::vector<std::vector<Face*> >          submeshFaces;
-	std::vector<float3*>		normals;
-	std::vector<float2*>		texcoords;
+private:
+	// one triangle corner, 0-based indices into the attribute arrays (-1 if the face left it out)
+	struct  Corner
+	{
+		int       position;
+		int       texcoord;
+		int       normal;
+	};
+
+	struct  Submesh
+	{
+		unsigned int    firstTriangle;
+		unsigned int    triangleCount;
+	};
+
+	struct  ObjChunk;
+
+	// welded vertices, one entry per unique position/normal/texcoord combination
+	std::vector<float>          positions;      // x,y,z
+	std::vector<float>          normals;        // x,y,z
+	std::vector<float>          texcoords;      // u,v with v already flipped for GL
+
+	// the same vertices in the compact formats, the float arrays above are empty then
+	std::vector<int16_t>        quantizedPositions; // x,y,z relative to the bounding box
+	std::vector<int16_t>        octNormals;         // 2 per vertex, VERTEX_FORMAT_COMPACT
+	std::vector<int8_t>         octNormalsLow;      // 2 per vertex, VERTEX_FORMAT_COMPACT_LOW
+	std::vector<uint16_t>       halfTexcoords;      // u,v
+	float                       dequantization[16]; // column major, quantized position -> object space
+	std::vector<unsigned int>   indices;        // 3 per triangle, grouped by level of detail and submesh
+
+	// every level of detail has the same submeshes, all levels share the vertices
+	std::vector<Submesh>        submeshes;      // submesh count per level, full detail first
+	std::vector<float>          lodErrors;      // largest surface deviation of each level, object units
+
+	Bounds                      bounds;
+	std::vector<Bounds>         submeshBounds;  // one per submesh, the same for every level of detail
+
+	std::string    filename;
+
+	int            modelid;         // display lists, only used without buffer objects
+
+	// interleaved position/normal/texcoord vertex buffer and its index buffer
+	unsigned int   vertexBuffer;
+	unsigned int   indexBuffer;
+	unsigned int   indexType;
+	unsigned int   vertexCount;
+	size_t         residentBytes;   // buffer sizes, or what the display lists hold as floats
 
-	int            modelid;
+	// buffer contents packed by the loader thread, released once uploaded
+	std::vector<char>   uploadVertices;
+	std::vector<char>   uploadIndices;
+
+	int            vertexFormat;
+
+	static unsigned int loaderThreads;
+	static int          defaultVertexFormat;
+	static bool         lodEnabled;
+	static unsigned int trianglesSubmitted;
+
+	// an empty mesh that is not submitted to AssetLoader, for parseObj()
+	Mesh();
+
+	static void parseObjChunk(const char *begin, const char *end, ObjChunk& chunk);
+	bool        loadObj(const char *filename);
+	void        weld(const ObjChunk& obj);
+	void        optimize();
+	void        generateLods();
+	void        quantize();
+	void        setDequantization(const float *offset, const float *scale);
+	void        decodeVertex(unsigned int vertex, float *position, float *normal, float *texcoord) const;
+	size_t      getStoredVertexCount() const;
+	// submeshes per level as built so far, getSubmeshCount() stays 0 until isLoaded()
+	unsigned int getLevelSubmeshCount() const;
+	void        computeBounds();
+	bool        loadCache(const char *cachePath, uint64_t sourceSize, int64_t sourceTime);
+	void        saveCache(const char *cachePath, uint64_t sourceSize, int64_t sourceTime);
+	void        buildDisplayLists();
+	void        packBuffers();
+	void        uploadBuffers();
+	void        bindBuffers();
+	void        unbindBuffers();
+	void        getLevelRange(unsigned int lod, unsigned int& firstTriangle, unsigned int& triangleCount) const;
+	void        drawTriangles(unsigned int firstTriangle, unsigned int triangleCount);
+	void        drawPlaceholder();
+
+protected:
+	void        loadData();
+	void        uploadData();
 
 public:
+	enum { VERTEX_FLOATS = 8 };
+
+	enum VertexFormat
+	{
+		VERTEX_FORMAT_FLOAT,        // 32 bytes per vertex
+		VERTEX_FORMAT_COMPACT,      // 14 bytes: 16 bit positions, 2x snorm16 octahedral normals, half texcoords
+		VERTEX_FORMAT_COMPACT_LOW,  // 12 bytes: the same with 2x snorm8 normals
+	};
+
+	// loads through AssetLoader, until the mesh is ready it draws its bounding box
 	Mesh(const char *filename);
 	~Mesh();
 
+	// number of threads used to parse .obj files, 0 picks one per core
+	static void setLoaderThreads(unsigned int threads);
+	// loadObj() alone, outside of AssetLoader, the cache and GL, for -meshbench;
+	// the triangle count, 0 if the file cannot be read
+	static size_t parseObj(const char *filename);
+	// the same followed by optimize(), with the post-transform cache statistics of the
+	// triangles before and after it for a FIFO of cacheSize vertices; false if unreadable
+	static bool analyzeObj(const char *filename, unsigned int cacheSize, VertexCacheStats& before, VertexCacheStats& after);
+	// vertex layout of meshes created from now on, in memory, in the cache and on the GPU
+	static void setVertexFormat(VertexFormat format);
+
 	void        draw();
 	void        drawSubmesh(unsigned int iSubmesh);
-};
 
+	// simplified versions of the mesh, level 0 is full detail
+	unsigned int getLodCount() const;
+	// coarsest level that still looks right when one object space unit covers
+	// screenPerUnit of the view height
+	unsigned int selectLod(float screenPerUnit) const;
+	void        drawLod(unsigned int lod);
+
+	// true once the mesh sits in buffer objects and GL can draw instances of it
+	bool        canDrawInstanced() const;
+	// column major, stored position -> object space; identity for VERTEX_FORMAT_FLOAT
+	const float* getDequantization() const;
+	// one glDrawElementsInstanced for the whole level; the caller binds the shader and the
+	// per-instance attributes, which have to apply getDequantization() themselves
+	void        drawLodInstanced(unsigned int lod, unsigned int instanceCount);
+
+	// object space bounds, computed once at load and kept in the cache,
+	// empty until isLoaded()
+	const Bounds& getBounds() const;
+	unsigned int getSubmeshCount() const;
+	const Bounds& getSubmeshBounds(unsigned int iSubmesh) const;
+
+	size_t      getResidentBytes() const;
+
+	static void setLodEnabled(bool enabled);
+	static bool isLodEnabled();
+	// triangles drawn since the last reset, for per-frame statistics
+	static unsigned int getTrianglesSubmitted();
+	static void resetTrianglesSubmitted();
+};
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MeshBenchmark.h"
+#include "Mesh.h"
+#include "MappedFile.h"
+#include "float2.h"
+#include "float3.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// The loader Mesh had before the mapped parser: every line is read into its own string,
+// then every record goes through sscanf into its own heap object, and the display list
+// took the faces apart corner by corner. glNormal3f/glTexCoord2f/glVertex3f are replaced
+// by appending the same floats to a vector. Faces the "%d/%d/%d" format cannot read
+// (v//n) are skipped, the old loader drew them from uninitialized indices.
+// Returns the triangle count, 0 if the file cannot be opened.
+static size_t loadObjReference(const char *filename)
+{
+	struct  Face
+	{
+		int       positionIndices[4];
+		int       normalIndices[4];
+		int       texcoordIndices[4];
+		bool      isQuad;
+	};
+
+	std::fstream file(filename);
+	if(!file.is_open())
+		return 0;
+
+	std::vector<std::string*> rows;
+	std::vector<float3*> positions;
+	std::vector<float3*> normals;
+	std::vector<float2*> texcoords;
+	std::vector<std::vector<Face*> > submeshFaces;
+
+	char buffer[256];
+	while(!file.eof())
+	{
+		file.getline(buffer, 256);
+		rows.push_back(new std::string(buffer));
+	}
+
+	submeshFaces.push_back(std::vector<Face*>());
+	std::vector<Face*>* faces = &submeshFaces.back();
+	for(size_t i = 0; i < rows.size(); i++)
+	{
+		const std::string& row = *rows[i];
+		if(row.empty() || row[0] == '#')
+			continue;
+		else if(row[0] == 'v' && row[1] == ' ')
+		{
+			float tmpx, tmpy, tmpz;
+			sscanf(row.c_str(), "v %f %f %f", &tmpx, &tmpy, &tmpz);
+			positions.push_back(new float3(tmpx, tmpy, tmpz));
+		}
+		else if(row[0] == 'v' && row[1] == 'n')
+		{
+			float tmpx, tmpy, tmpz;
+			sscanf(row.c_str(), "vn %f %f %f", &tmpx, &tmpy, &tmpz);
+			normals.push_back(new float3(tmpx, tmpy, tmpz));
+		}
+		else if(row[0] == 'v' && row[1] == 't')
+		{
+			float tmpx, tmpy;
+			sscanf(row.c_str(), "vt %f %f", &tmpx, &tmpy);
+			texcoords.push_back(new float2(tmpx, tmpy));
+		}
+		else if(row[0] == 'f')
+		{
+			Face* f = new Face();
+			f->isQuad = std::count(row.begin(), row.end(), ' ') != 3;
+			int read = sscanf(row.c_str(), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
+				&f->positionIndices[0], &f->texcoordIndices[0], &f->normalIndices[0],
+				&f->positionIndices[1], &f->texcoordIndices[1], &f->normalIndices[1],
+				&f->positionIndices[2], &f->texcoordIndices[2], &f->normalIndices[2],
+				&f->positionIndices[3], &f->texcoordIndices[3], &f->normalIndices[3]);
+			if(read == (f->isQuad ? 12 : 9))
+				faces->push_back(f);
+			else
+				delete f;
+		}
+		else if(row[0] == 'g')
+		{
+			if(faces->size() > 0)
+			{
+				submeshFaces.push_back(std::vector<Face*>());
+				faces = &submeshFaces.back();
+			}
+		}
+	}
+
+	// quads as (0,1,2) and (1,2,3), like the display lists
+	static const int quadCorners[6] = { 0, 1, 2, 1, 2, 3 };
+	std::vector<float> recorded;
+	size_t triangles = 0;
+	for(size_t iSubmesh = 0; iSubmesh < submeshFaces.size(); iSubmesh++)
+	{
+		for(size_t i = 0; i < submeshFaces[iSubmesh].size(); i++)
+		{
+			const Face* f = submeshFaces[iSubmesh][i];
+			int nCorners = f->isQuad ? 6 : 3;
+			for(int iCorner = 0; iCorner < nCorners; iCorner++)
+			{
+				int v = quadCorners[iCorner];
+				const float3* normal = normals[f->normalIndices[v] - 1];
+				const float2* texcoord = texcoords[f->texcoordIndices[v] - 1];
+				const float3* position = positions[f->positionIndices[v] - 1];
+				float corner[8] = { normal->x, normal->y, normal->z, texcoord->x, 1 - texcoord->y, position->x, position->y, position->z };
+				recorded.insert(recorded.end(), corner, corner + 8);
+			}
+			triangles += nCorners / 3;
+		}
+	}
+
+	for(size_t i = 0; i < rows.size(); i++)
+		delete rows[i];
+	for(size_t i = 0; i < positions.size(); i++)
+		delete positions[i];
+	for(size_t i = 0; i < normals.size(); i++)
+		delete normals[i];
+	for(size_t i = 0; i < texcoords.size(); i++)
+		delete texcoords[i];
+	for(size_t iSubmesh = 0; iSubmesh < submeshFaces.size(); iSubmesh++)
+	{
+		for(size_t i = 0; i < submeshFaces[iSubmesh].size(); i++)
+			delete submeshFaces[iSubmesh][i];
+	}
+	return triangles;
+}
+
+// loads filename iterations times, returns the milliseconds per load and the triangle count
+static double timeLoad(size_t (*load)(const char*), const char* filename, int iterations, size_t& triangles)
+{
+	Clock::time_point start = Clock::now();
+	for(int iteration = 0; iteration < iterations; iteration++)
+		triangles = load(filename);
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+}
+
+// The given files appended to each other until they make up at least minSize bytes,
+// written to filename; the size written, 0 if nothing could be. The copies stay valid
+// .obj: their 1-based indices point back into the first copies, relative ones into
+// their own.
+static size_t writeLargeObj(const char* filename, const char* const *filenames, int count, size_t minSize)
+{
+	FILE* file = fopen(filename, "wb");
+	if(!file)
+		return 0;
+	size_t size = 0;
+	bool appended = true;
+	while(size < minSize && appended)
+	{
+		appended = false;
+		for(int i = 0; i < count; i++)
+		{
+			MappedFile source(filenames[i]);
+			if(source.getSize() == 0)
+				continue;
+			fwrite(source.begin(), 1, source.getSize(), file);
+			fputc('\n', file);
+			size += source.getSize() + 1;
+			appended = true;
+		}
+	}
+	fclose(file);
+	return size;
+}
+
+// Mesh::parseObj of one large file with 1, 2, 4 and 8 loader threads
+static void runThreadBenchmark(const char* const *filenames, int count)
+{
+	const char* largeObj = "meshbench-threads.obj";
+	const unsigned int threadCounts[] = { 1, 2, 4, 8 };
+	const int iterations = 5;
+
+	size_t size = writeLargeObj(largeObj, filenames, count, (size_t)32 << 20);
+	if(size == 0)
+	{
+		printf("%s cannot be written\n", largeObj);
+		return;
+	}
+	double megabytes = size / (1024.0 * 1024.0);
+	printf("\n%.1f MB of the meshes above, %u cores\n", megabytes, std::thread::hardware_concurrency());
+	printf("%-8s %10s %10s %8s %10s\n", "threads", "ms", "MB/s", "speedup", "tris");
+	double singleTime = 0;
+	for(size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++)
+	{
+		Mesh::setLoaderThreads(threadCounts[t]);
+		size_t triangles;
+		double time = timeLoad(Mesh::parseObj, largeObj, iterations, triangles);
+		if(t == 0)
+			singleTime = time;
+		printf("%-8u %10.2f %10.1f %7.2fx %10u\n", threadCounts[t], time, megabytes * 1000 / time, singleTime / time, (unsigned int)triangles);
+	}
+	// back to one thread per core
+	Mesh::setLoaderThreads(0);
+	remove(largeObj);
+}
+
+// ACMR and ATVR of every mesh before and after Mesh::optimize, for two cache sizes
+static void runVertexCacheBenchmark(const char* const *filenames, int count)
+{
+	const unsigned int cacheSizes[] = { 16, 32 };
+
+	printf("\n%-12s %6s %11s %11s %11s %11s\n", "mesh", "cache", "acmr before", "acmr after", "atvr before", "atvr after");
+	for(int i = 0; i < count; i++)
+	{
+		for(size_t c = 0; c < sizeof(cacheSizes) / sizeof(cacheSizes[0]); c++)
+		{
+			VertexCacheStats before, after;
+			if(!Mesh::analyzeObj(filenames[i], cacheSizes[c], before, after))
+			{
+				printf("%-12s cannot be read\n", filenames[i]);
+				break;
+			}
+			printf("%-12s %6u %11.3f %11.3f %11.3f %11.3f\n", filenames[i], cacheSizes[c], before.acmr, after.acmr, before.atvr, after.atvr);
+		}
+	}
+}
+
+void runMeshBenchmark(const char* const *filenames, int count)
+{
+	const int iterations = 20;
+
+	printf("%-12s %9s %10s %10s %8s %10s %10s %9s %9s\n", "mesh", "size", "ref ms", "mapped ms", "speedup",
+		"ref MB/s", "map MB/s", "ref tris", "map tris");
+	for(int i = 0; i < count; i++)
+	{
+		size_t size = MappedFile(filenames[i]).getSize();
+		size_t referenceTriangles, mappedTriangles;
+		double referenceTime = timeLoad(loadObjReference, filenames[i], iterations, referenceTriangles);
+		double mappedTime = timeLoad(Mesh::parseObj, filenames[i], iterations, mappedTriangles);
+		if(size == 0 || mappedTriangles == 0)
+		{
+			printf("%-12s cannot be read\n", filenames[i]);
+			continue;
+		}
+		double megabytes = size / (1024.0 * 1024.0);
+		printf("%-12s %9u %10.2f %10.2f %7.2fx %10.1f %10.1f %9u %9u\n", filenames[i], (unsigned int)size,
+			referenceTime, mappedTime, referenceTime / mappedTime, megabytes * 1000 / referenceTime,
+			megabytes * 1000 / mappedTime, (unsigned int)referenceTriangles, (unsigned int)mappedTriangles);
+	}
+
+	runVertexCacheBenchmark(filenames, count);
+	runThreadBenchmark(filenames, count);
+}
@@ -0,0 +1,26 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "MeshCache.h"
+
+using namespace std;
+
+bool getMeshSourceStamp(const char *filename, uint64_t& size, int64_t& time)
+{
+	struct stat info;
+	if(stat(filename, &info) != 0)
+		return false;
+	size = (uint64_t)info.st_size;
+	time = (int64_t)info.st_mtime;
+	return true;
+}
+
+string getMeshCachePath(const char *filename)
+{
+	string path(filename);
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if(dot != string::npos && (slash == string::npos || dot > slash))
+		path.erase(dot);
+	return path + ".dtmesh";
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+// Binary layout of a precompiled mesh (.dtmesh), written next to the .obj it was built from.
+// The header is followed by the submesh table (submeshCount entries per level of detail),
+// one error float per level, the bounds of the whole mesh followed by those of each
+// submesh, then the welded vertices as flat arrays of positions (3 floats),
+// normals (3 floats) and texcoords (2 floats), then the triangle indices (3 uint32 each) of
+// all levels, already in vertex cache friendly order.
+// Compact vertex formats store the dequantization offset and scale (3 floats each), then
+// positions (3 int16), octahedral normals (2 int16 or 2 int8) and half texcoords (2 uint16),
+// padded to 4 bytes before the indices.
+// A cache is only used when the size and modification time of the source still match.
+
+#define MESH_CACHE_VERSION 7
+
+struct  MeshCacheHeader
+{
+	char        magic[4];
+	uint32_t    version;
+	uint64_t    sourceSize;
+	int64_t     sourceTime;
+	uint32_t    vertexCount;
+	uint32_t    triangleCount;
+	uint32_t    submeshCount;       // per level of detail
+	uint32_t    lodCount;
+	uint32_t    vertexFormat;       // Mesh::VertexFormat
+	uint32_t    reserved;
+};
+
+struct  MeshCacheSubmesh
+{
+	uint32_t    firstTriangle;
+	uint32_t    triangleCount;
+};
+
+struct  MeshCacheBounds
+{
+	float       minimum[3];
+	float       maximum[3];
+	float       center[3];
+	float       radius;
+};
+
+// Size and modification time of the source file, false if it cannot be found.
+bool        getMeshSourceStamp(const char *filename, uint64_t& size, int64_t& time);
+// "truck1.obj" -> "truck1.dtmesh"
+std::string getMeshCachePath(const char *filename);
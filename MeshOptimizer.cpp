@@ -0,0 +1,586 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "MeshOptimizer.h"
+
+// Forsyth's scoring: vertices recently used score high (the three from the last
+// triangle a bit lower to avoid strips turning back on themselves), and vertices
+// with few remaining triangles get a boost so they are finished off early.
+static const int   cacheSize = 32;
+static const float cacheDecayPower = 1.5f;
+static const float lastTriangleScore = 0.75f;
+static const float valenceBoostScale = 2.0f;
+static const float valenceBoostPower = 0.5f;
+
+static float vertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+	if(remainingTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if(cachePosition >= 0)
+	{
+		if(cachePosition < 3)
+			score = lastTriangleScore;
+		else
+			score = powf(1.0f - (cachePosition - 3) * (1.0f / (cacheSize - 3)), cacheDecayPower);
+	}
+	return score + valenceBoostScale * powf((float)remainingTriangles, -valenceBoostPower);
+}
+
+void optimizeVertexCache(unsigned int *indices, size_t indexCount, size_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if(triangleCount == 0)
+		return;
+
+	// triangles adjacent to each vertex, as offsets into one shared array
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+	for(size_t i = 0; i < indexCount; i++)
+		adjacencyOffsets[indices[i] + 1]++;
+	for(size_t v = 0; v < vertexCount; v++)
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	std::vector<unsigned int> adjacency(indexCount);
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for(size_t i = 0; i < indexCount; i++)
+	{
+		unsigned int v = indices[i];
+		adjacency[adjacencyOffsets[v] + remaining[v]++] = (unsigned int)(i / 3);
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> scoreOfVertex(vertexCount);
+	for(size_t v = 0; v < vertexCount; v++)
+		scoreOfVertex[v] = vertexScore(-1, remaining[v]);
+
+	std::vector<float> scoreOfTriangle(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for(size_t t = 0; t < triangleCount; t++)
+		scoreOfTriangle[t] = scoreOfVertex[indices[t*3]] + scoreOfVertex[indices[t*3+1]] + scoreOfVertex[indices[t*3+2]];
+
+	std::vector<unsigned int> output;
+	output.reserve(indexCount);
+
+	unsigned int cache[cacheSize + 3];
+	int cacheCount = 0;
+	size_t scanPosition = 0;
+	int bestTriangle = -1;
+
+	for(size_t iOutput = 0; iOutput < triangleCount; iOutput++)
+	{
+		if(bestTriangle < 0)
+		{
+			// nothing adjacent to the cache is left, take the best remaining triangle
+			float bestScore = -1e30f;
+			while(scanPosition < triangleCount && emitted[scanPosition])
+				scanPosition++;
+			for(size_t t = scanPosition; t < triangleCount; t++)
+			{
+				if(!emitted[t] && scoreOfTriangle[t] > bestScore)
+				{
+					bestScore = scoreOfTriangle[t];
+					bestTriangle = (int)t;
+				}
+			}
+		}
+
+		const unsigned int* triangle = &indices[bestTriangle * 3];
+		output.insert(output.end(), triangle, triangle + 3);
+		emitted[bestTriangle] = true;
+
+		// take the triangle out of its vertices' adjacency lists
+		for(int k = 0; k < 3; k++)
+		{
+			unsigned int v = triangle[k];
+			unsigned int* list = &adjacency[adjacencyOffsets[v]];
+			for(unsigned int j = 0; j < remaining[v]; j++)
+			{
+				if(list[j] == (unsigned int)bestTriangle)
+				{
+					list[j] = list[remaining[v] - 1];
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// move the triangle's vertices to the front of the cache
+		unsigned int newCache[cacheSize + 3];
+		int newCount = 0;
+		for(int k = 0; k < 3; k++)
+			newCache[newCount++] = triangle[k];
+		for(int j = 0; j < cacheCount; j++)
+		{
+			unsigned int v = cache[j];
+			if(v != triangle[0] && v != triangle[1] && v != triangle[2])
+				newCache[newCount++] = v;
+		}
+
+		// vertices pushed out of the cache lose their cache score
+		for(int j = cacheSize; j < newCount; j++)
+		{
+			unsigned int v = newCache[j];
+			cachePosition[v] = -1;
+			scoreOfVertex[v] = vertexScore(-1, remaining[v]);
+		}
+		cacheCount = newCount < cacheSize ? newCount : cacheSize;
+		memcpy(cache, newCache, cacheCount * sizeof(unsigned int));
+
+		// rescore everything touching the cache and pick the next triangle from there
+		for(int j = 0; j < cacheCount; j++)
+		{
+			unsigned int v = cache[j];
+			cachePosition[v] = j;
+			scoreOfVertex[v] = vertexScore(j, remaining[v]);
+		}
+
+		bestTriangle = -1;
+		float bestScore = -1e30f;
+		for(int j = 0; j < cacheCount; j++)
+		{
+			unsigned int v = cache[j];
+			const unsigned int* list = &adjacency[adjacencyOffsets[v]];
+			for(unsigned int a = 0; a < remaining[v]; a++)
+			{
+				unsigned int t = list[a];
+				float score = scoreOfVertex[indices[t*3]] + scoreOfVertex[indices[t*3+1]] + scoreOfVertex[indices[t*3+2]];
+				scoreOfTriangle[t] = score;
+				if(score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = (int)t;
+				}
+			}
+		}
+	}
+
+	memcpy(indices, &output[0], indexCount * sizeof(unsigned int));
+}
+
+size_t optimizeVertexFetch(unsigned int *indices, size_t indexCount, size_t vertexCount, unsigned int *remap)
+{
+	for(size_t v = 0; v < vertexCount; v++)
+		remap[v] = ~0u;
+
+	unsigned int nextVertex = 0;
+	for(size_t i = 0; i < indexCount; i++)
+	{
+		unsigned int& target = remap[indices[i]];
+		if(target == ~0u)
+			target = nextVertex++;
+		indices[i] = target;
+	}
+	return nextVertex;
+}
+
+void remapVertexAttribute(float *values, size_t vertexCount, size_t components, const unsigned int *remap)
+{
+	std::vector<float> original(values, values + vertexCount * components);
+	for(size_t v = 0; v < vertexCount; v++)
+	{
+		if(remap[v] != ~0u)
+			memcpy(values + remap[v] * components, &original[v * components], components * sizeof(float));
+	}
+}
+
+VertexCacheStats analyzeVertexCache(const unsigned int *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+	// timestamps stand in for the FIFO: a vertex is cached while fewer than cacheSize misses happened since it was loaded
+	std::vector<size_t> loadedAt(vertexCount, 0);
+	std::vector<bool> referenced(vertexCount, false);
+	size_t misses = 0;
+	size_t referencedCount = 0;
+	for(size_t i = 0; i < indexCount; i++)
+	{
+		unsigned int v = indices[i];
+		if(!referenced[v])
+		{
+			referenced[v] = true;
+			referencedCount++;
+		}
+		if(loadedAt[v] == 0 || misses - loadedAt[v] + 1 > cacheSize)
+		{
+			misses++;
+			loadedAt[v] = misses;
+		}
+	}
+
+	VertexCacheStats stats;
+	stats.acmr = indexCount ? (float)misses / (indexCount / 3) : 0.0f;
+	stats.atvr = referencedCount ? (float)misses / referencedCount : 0.0f;
+	return stats;
+}
+
+// Symmetric 4x4 matrix of the summed squared distances to a set of planes,
+// scaled by the total weight so evaluate() returns a squared distance.
+struct  Quadric
+{
+	double  a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+	double  weight;
+
+	void    clear()
+	{
+		a00 = a01 = a02 = a03 = a11 = a12 = a13 = a22 = a23 = a33 = weight = 0.0;
+	}
+
+	void    addPlane(double nx, double ny, double nz, double d, double w)
+	{
+		a00 += w*nx*nx; a01 += w*nx*ny; a02 += w*nx*nz; a03 += w*nx*d;
+		a11 += w*ny*ny; a12 += w*ny*nz; a13 += w*ny*d;
+		a22 += w*nz*nz; a23 += w*nz*d;
+		a33 += w*d*d;
+		weight += w;
+	}
+
+	void    add(const Quadric& q)
+	{
+		a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+		a11 += q.a11; a12 += q.a12; a13 += q.a13;
+		a22 += q.a22; a23 += q.a23;
+		a33 += q.a33;
+		weight += q.weight;
+	}
+
+	double  evaluate(const float* p) const
+	{
+		double x = p[0], y = p[1], z = p[2];
+		double result = a00*x*x + 2*a01*x*y + 2*a02*x*z + 2*a03*x
+			+ a11*y*y + 2*a12*y*z + 2*a13*y
+			+ a22*z*z + 2*a23*z
+			+ a33;
+		return weight > 0.0 ? fabs(result) / weight : 0.0;
+	}
+};
+
+enum VertexKind
+{
+	VERTEX_MANIFOLD,    // interior vertex, can collapse onto any neighbour
+	VERTEX_BORDER,      // on an open border, only collapses along it
+	VERTEX_SEAM,        // one of two vertices sharing a position, collapses along the seam together with its twin
+	VERTEX_LOCKED,      // never moves
+};
+
+static inline unsigned long long edgeKey(unsigned int a, unsigned int b)
+{
+	return ((unsigned long long)a << 32) | b;
+}
+
+static void triangleNormal(const float* p0, const float* p1, const float* p2, float* normal)
+{
+	float e1[3] = { p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2] };
+	float e2[3] = { p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2] };
+	normal[0] = e1[1]*e2[2] - e1[2]*e2[1];
+	normal[1] = e1[2]*e2[0] - e1[0]*e2[2];
+	normal[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+// true if moving `from` onto `to` leaves every remaining triangle around `from` facing the same way
+static bool collapseKeepsOrientation(const unsigned int* indices, const std::vector<unsigned int>& triangles,
+			const float* positions, unsigned int from, unsigned int to)
+{
+	for(size_t i = 0; i < triangles.size(); i++)
+	{
+		const unsigned int* triangle = &indices[triangles[i] * 3];
+		if(triangle[0] == to || triangle[1] == to || triangle[2] == to)
+			continue;
+
+		const float* before[3];
+		const float* after[3];
+		for(int k = 0; k < 3; k++)
+		{
+			before[k] = &positions[triangle[k] * 3];
+			after[k] = triangle[k] == from ? &positions[to * 3] : before[k];
+		}
+		float n0[3], n1[3];
+		triangleNormal(before[0], before[1], before[2], n0);
+		triangleNormal(after[0], after[1], after[2], n1);
+		if(n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2] <= 0.0f)
+			return false;
+	}
+	return true;
+}
+
+size_t simplifyMesh(unsigned int *destination, const unsigned int *indices, size_t indexCount,
+			const float *positions, size_t vertexCount, const unsigned char *locked,
+			size_t targetIndexCount, float& error)
+{
+	error = 0.0f;
+	std::vector<unsigned int> current(indices, indices + indexCount);
+
+	// vertices at bit-identical positions form one class, linked in a ring through nextWedge
+	std::vector<unsigned int> positionClass(vertexCount);
+	std::vector<unsigned int> nextWedge(vertexCount);
+	std::vector<unsigned int> classSize(vertexCount, 0);
+	{
+		std::unordered_map<PositionKey, unsigned int, PositionKeyHash> firstAt;
+		firstAt.reserve(vertexCount);
+		for(size_t v = 0; v < vertexCount; v++)
+		{
+			PositionKey key;
+			memcpy(key.bits, &positions[v * 3], sizeof(key.bits));
+			unsigned int representative = firstAt.insert(std::make_pair(key, (unsigned int)v)).first->second;
+			positionClass[v] = representative;
+			if(representative == v)
+				nextWedge[v] = (unsigned int)v;
+			else
+			{
+				nextWedge[v] = nextWedge[representative];
+				nextWedge[representative] = (unsigned int)v;
+			}
+		}
+		for(size_t v = 0; v < vertexCount; v++)
+			classSize[positionClass[v]]++;
+	}
+
+	// open half-edges: vertex space ones are borders or seams, position space ones are real borders
+	std::unordered_map<unsigned long long, int> vertexEdges, classEdges;
+	for(size_t i = 0; i < indexCount; i += 3)
+	{
+		for(int k = 0; k < 3; k++)
+		{
+			unsigned int a = current[i + k], b = current[i + (k + 1) % 3];
+			vertexEdges[edgeKey(a, b)]++;
+			classEdges[edgeKey(positionClass[a], positionClass[b])]++;
+		}
+	}
+	std::vector<int> openVertexEdges(vertexCount, 0), openClassEdges(vertexCount, 0);
+	for(std::unordered_map<unsigned long long, int>::iterator e = vertexEdges.begin(); e != vertexEdges.end(); ++e)
+	{
+		unsigned int a = (unsigned int)(e->first >> 32), b = (unsigned int)e->first;
+		if(vertexEdges.find(edgeKey(b, a)) == vertexEdges.end())
+		{
+			openVertexEdges[a]++;
+			openVertexEdges[b]++;
+		}
+	}
+	for(std::unordered_map<unsigned long long, int>::iterator e = classEdges.begin(); e != classEdges.end(); ++e)
+	{
+		unsigned int a = (unsigned int)(e->first >> 32), b = (unsigned int)e->first;
+		if(classEdges.find(edgeKey(b, a)) == classEdges.end())
+		{
+			openClassEdges[a]++;
+			openClassEdges[b]++;
+		}
+	}
+
+	std::vector<unsigned char> kind(vertexCount, VERTEX_LOCKED);
+	for(size_t v = 0; v < vertexCount; v++)
+	{
+		unsigned int c = positionClass[v];
+		if(locked != 0 && locked[v])
+			continue;
+		if(classSize[c] == 1)
+		{
+			if(openClassEdges[c] == 0)
+				kind[v] = VERTEX_MANIFOLD;
+			else if(openClassEdges[c] == 2)
+				kind[v] = VERTEX_BORDER;
+		}
+		else if(classSize[c] == 2 && openClassEdges[c] == 0 && openVertexEdges[v] == 2)
+			kind[v] = VERTEX_SEAM;
+	}
+	// a locked wedge locks its twin too
+	for(size_t v = 0; v < vertexCount; v++)
+		if(kind[v] == VERTEX_LOCKED)
+			for(unsigned int w = nextWedge[v]; w != v; w = nextWedge[w])
+				kind[w] = VERTEX_LOCKED;
+
+	// quadrics live on position classes: planes of the triangles plus, for borders,
+	// a perpendicular plane along the border edge that keeps the outline in place
+	std::vector<Quadric> quadrics(vertexCount);
+	for(size_t v = 0; v < vertexCount; v++)
+		quadrics[v].clear();
+	for(size_t i = 0; i < indexCount; i += 3)
+	{
+		const float* p[3] = { &positions[current[i] * 3], &positions[current[i+1] * 3], &positions[current[i+2] * 3] };
+		float n[3];
+		triangleNormal(p[0], p[1], p[2], n);
+		double length = sqrt((double)n[0]*n[0] + (double)n[1]*n[1] + (double)n[2]*n[2]);
+		if(length == 0.0)
+			continue;
+		double nx = n[0] / length, ny = n[1] / length, nz = n[2] / length;
+		double d = -(nx*p[0][0] + ny*p[0][1] + nz*p[0][2]);
+		double area = length * 0.5;
+		for(int k = 0; k < 3; k++)
+			quadrics[positionClass[current[i+k]]].addPlane(nx, ny, nz, d, area);
+
+		for(int k = 0; k < 3; k++)
+		{
+			unsigned int a = positionClass[current[i+k]], b = positionClass[current[i+(k+1)%3]];
+			if(classEdges.find(edgeKey(b, a)) != classEdges.end())
+				continue;
+			const float* pa = p[k];
+			const float* pb = p[(k+1)%3];
+			double e[3] = { pb[0]-pa[0], pb[1]-pa[1], pb[2]-pa[2] };
+			double edgeLength = sqrt(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+			if(edgeLength == 0.0)
+				continue;
+			// perpendicular to the triangle, containing the edge
+			double bx = e[1]*nz - e[2]*ny, by = e[2]*nx - e[0]*nz, bz = e[0]*ny - e[1]*nx;
+			double bLength = sqrt(bx*bx + by*by + bz*bz);
+			bx /= bLength; by /= bLength; bz /= bLength;
+			double bd = -(bx*pa[0] + by*pa[1] + bz*pa[2]);
+			quadrics[a].addPlane(bx, by, bz, bd, edgeLength * edgeLength * 10.0);
+			quadrics[b].addPlane(bx, by, bz, bd, edgeLength * edgeLength * 10.0);
+		}
+	}
+
+	struct  Collapse
+	{
+		unsigned int    from;
+		unsigned int    to;
+		double          cost;
+		bool operator<(const Collapse& other) const { return cost < other.cost; }
+	};
+
+	std::vector<unsigned int> collapseTo(vertexCount);
+	std::vector<unsigned char> touched(vertexCount);
+	std::vector<unsigned int> triangleOffsets(vertexCount + 1);
+	std::vector<unsigned int> triangleList;
+
+	while(current.size() > targetIndexCount)
+	{
+		// triangles around each vertex
+		std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+		for(size_t i = 0; i < current.size(); i++)
+			triangleOffsets[current[i] + 1]++;
+		for(size_t v = 0; v < vertexCount; v++)
+			triangleOffsets[v + 1] += triangleOffsets[v];
+		triangleList.resize(current.size());
+		{
+			std::vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for(size_t i = 0; i < current.size(); i++)
+				triangleList[fill[current[i]]++] = (unsigned int)(i / 3);
+		}
+
+		vertexEdges.clear();
+		for(size_t i = 0; i < current.size(); i += 3)
+			for(int k = 0; k < 3; k++)
+				vertexEdges[edgeKey(current[i + k], current[i + (k + 1) % 3])]++;
+
+		// cheapest allowed collapse per vertex
+		std::vector<Collapse> candidates;
+		for(size_t i = 0; i < current.size(); i += 3)
+		{
+			for(int k = 0; k < 6; k++)
+			{
+				unsigned int from = current[i + k % 3];
+				unsigned int to = current[i + (k < 3 ? (k + 1) % 3 : (k + 2) % 3)];
+				unsigned int fromClass = positionClass[from], toClass = positionClass[to];
+				if(fromClass == toClass)
+					continue;
+
+				unsigned char fromKind = kind[from];
+				if(fromKind == VERTEX_LOCKED)
+					continue;
+				if(fromKind == VERTEX_BORDER)
+				{
+					bool borderEdge = classEdges.find(edgeKey(toClass, fromClass)) == classEdges.end()
+						|| classEdges.find(edgeKey(fromClass, toClass)) == classEdges.end();
+					if(!borderEdge || kind[to] == VERTEX_MANIFOLD)
+						continue;
+				}
+				if(fromKind == VERTEX_SEAM)
+				{
+					bool seamEdge = vertexEdges.find(edgeKey(to, from)) == vertexEdges.end()
+						|| vertexEdges.find(edgeKey(from, to)) == vertexEdges.end();
+					if(!seamEdge || kind[to] == VERTEX_MANIFOLD || kind[to] == VERTEX_BORDER)
+						continue;
+				}
+
+				Quadric q = quadrics[fromClass];
+				q.add(quadrics[toClass]);
+				Collapse collapse = { from, to, q.evaluate(&positions[to * 3]) };
+				candidates.push_back(collapse);
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		for(size_t v = 0; v < vertexCount; v++)
+			collapseTo[v] = (unsigned int)v;
+		std::fill(touched.begin(), touched.end(), 0);
+
+		size_t removable = (current.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		for(size_t iCandidate = 0; iCandidate < candidates.size() && removed < removable; iCandidate++)
+		{
+			const Collapse& collapse = candidates[iCandidate];
+			unsigned int from = collapse.from, to = collapse.to;
+			if(touched[from] || touched[to])
+				continue;
+
+			// a seam vertex drags its twin along the matching seam edge
+			unsigned int twinFrom = from, twinTo = to;
+			if(kind[from] == VERTEX_SEAM)
+			{
+				twinFrom = nextWedge[from];
+				twinTo = ~0u;
+				for(unsigned int w = nextWedge[to]; w != to; w = nextWedge[w])
+				{
+					if(vertexEdges.find(edgeKey(twinFrom, w)) != vertexEdges.end() || vertexEdges.find(edgeKey(w, twinFrom)) != vertexEdges.end())
+						twinTo = w;
+				}
+				if(twinTo == ~0u || touched[twinFrom] || touched[twinTo])
+					continue;
+			}
+
+			std::vector<unsigned int> around(&triangleList[triangleOffsets[from]], &triangleList[triangleOffsets[from + 1]]);
+			if(!collapseKeepsOrientation(&current[0], around, positions, from, to))
+				continue;
+			std::vector<unsigned int> twinAround(&triangleList[triangleOffsets[twinFrom]], &triangleList[triangleOffsets[twinFrom + 1]]);
+			if(twinFrom != from && !collapseKeepsOrientation(&current[0], twinAround, positions, twinFrom, twinTo))
+				continue;
+
+			// freeze the neighbourhood so later collapses this pass see up to date triangles
+			for(int side = 0; side < (twinFrom != from ? 2 : 1); side++)
+			{
+				const std::vector<unsigned int>& triangles = side == 0 ? around : twinAround;
+				unsigned int target = side == 0 ? to : twinTo;
+				for(size_t t = 0; t < triangles.size(); t++)
+				{
+					const unsigned int* triangle = &current[triangles[t] * 3];
+					for(int k = 0; k < 3; k++)
+						for(unsigned int w = triangle[k]; ; )
+						{
+							touched[w] = 1;
+							w = nextWedge[w];
+							if(w == triangle[k])
+								break;
+						}
+					if(triangle[0] == target || triangle[1] == target || triangle[2] == target)
+						removed++;
+				}
+			}
+
+			collapseTo[from] = to;
+			collapseTo[twinFrom] = twinTo;
+			quadrics[positionClass[to]].add(quadrics[positionClass[from]]);
+			float distance = (float)sqrt(collapse.cost);
+			if(distance > error)
+				error = distance;
+		}
+
+		if(removed == 0)
+			break;
+
+		// apply the collapses and drop the triangles that became degenerate
+		size_t write = 0;
+		for(size_t i = 0; i < current.size(); i += 3)
+		{
+			unsigned int a = collapseTo[current[i]], b = collapseTo[current[i+1]], c = collapseTo[current[i+2]];
+			if(a == b || b == c || a == c)
+				continue;
+			current[write++] = a;
+			current[write++] = b;
+			current[write++] = c;
+		}
+		current.resize(write);
+	}
+
+	if(!current.empty())
+		memcpy(destination, &current[0], current.size() * sizeof(unsigned int));
+	return current.size();
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stddef.h>
+
+// Load-time passes over indexed triangle lists (3 indices per triangle).
+
+// Reorders the triangles of indices[0..indexCount) so consecutive triangles reuse
+// recently transformed vertices (Tom Forsyth's linear-speed vertex cache optimisation).
+void    optimizeVertexCache(unsigned int *indices, size_t indexCount, size_t vertexCount);
+
+// Renumbers vertices in the order the index list first uses them, so vertex fetches
+// walk the vertex buffer front to back. Fills remap[old vertex] = new vertex and returns
+// the number of vertices still referenced (unreferenced ones map to ~0u).
+size_t  optimizeVertexFetch(unsigned int *indices, size_t indexCount, size_t vertexCount, unsigned int *remap);
+
+// Moves the vertex attributes to their remapped slots, `components` floats per vertex.
+void    remapVertexAttribute(float *values, size_t vertexCount, size_t components, const unsigned int *remap);
+
+// A position compared bit for bit, for hash maps that find vertices sharing a position.
+struct  PositionKey
+{
+	unsigned int    bits[3];
+
+	bool operator==(const PositionKey& other) const
+	{
+		return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+	}
+};
+
+struct  PositionKeyHash
+{
+	size_t operator()(const PositionKey& key) const
+	{
+		return (size_t)(key.bits[0] * 73856093u ^ key.bits[1] * 19349663u ^ key.bits[2] * 83492791u);
+	}
+};
+
+struct  VertexCacheStats
+{
+	float   acmr;       // transformed vertices per triangle
+	float   atvr;       // transformed vertices per referenced vertex, 1 is ideal
+};
+
+// Simulates a FIFO post-transform cache of the given size.
+VertexCacheStats analyzeVertexCache(const unsigned int *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize);
+
+// Quadric error metric edge collapse. Writes a simplified copy of indices[0..indexCount)
+// to destination and returns its index count, stopping once targetIndexCount is reached
+// or nothing else can collapse. Vertices only ever collapse onto existing vertices, so the
+// result shares the vertex buffer. Vertices flagged in locked[] never move; UV and normal
+// seams (several vertices at one position) only collapse along the seam, and open borders
+// only along the border. error receives the largest collapse distance in object units.
+size_t  simplifyMesh(unsigned int *destination, const unsigned int *indices, size_t indexCount,
+			const float *positions, size_t vertexCount, const unsigned char *locked,
+			size_t targetIndexCount, float& error);
@@ -0,0 +1,127 @@
+#include <math.h>
+#include <string.h>
+
+#include "MeshQuantization.h"
+
+uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t magnitude = bits & 0x7FFFFFFF;
+
+	if(magnitude >= 0x7F800000)     // infinity or NaN
+		return (uint16_t)(sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0));
+	if(magnitude >= 0x477FF000)     // rounds past the largest half
+		return (uint16_t)(sign | 0x7C00);
+	if(magnitude < 0x38800000)      // half denormal or zero
+	{
+		if(magnitude < 0x33000000)
+			return (uint16_t)sign;
+		uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+		int shift = 126 - (int)(magnitude >> 23);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if(rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return (uint16_t)(sign | half);
+	}
+
+	// rebias the exponent, then round the 13 dropped mantissa bits to nearest even
+	uint32_t half = (magnitude - 0x38000000) >> 13;
+	uint32_t rest = magnitude & 0x1FFF;
+	if(rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return (uint16_t)(sign | half);
+}
+
+float halfToFloat(uint16_t value)
+{
+	uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+
+	uint32_t bits;
+	if(exponent == 0x1F)
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	else if(exponent != 0)
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	else if(mantissa == 0)
+		bits = sign;
+	else
+	{
+		// normalize the denormal
+		exponent = 113;
+		while((mantissa & 0x400) == 0)
+		{
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+int quantizeSnorm(float value, int bits)
+{
+	float scale = (float)((1 << (bits - 1)) - 1);
+	if(value > 1.0f)
+		value = 1.0f;
+	if(value < -1.0f)
+		value = -1.0f;
+	return (int)floorf(value * scale + 0.5f);
+}
+
+float dequantizeSnorm(int value, int bits)
+{
+	float scale = (float)((1 << (bits - 1)) - 1);
+	float result = value / scale;
+	return result < -1.0f ? -1.0f : result;
+}
+
+void encodeOctahedral(const float *normal, float *octahedral)
+{
+	float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+	if(length == 0.0f)
+	{
+		octahedral[0] = 0.0f;
+		octahedral[1] = 1.0f;
+		return;
+	}
+
+	float x = normal[0] / length;
+	float y = normal[1] / length;
+	if(normal[2] < 0.0f)
+	{
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	octahedral[0] = x;
+	octahedral[1] = y;
+}
+
+void decodeOctahedral(const float *octahedral, float *normal)
+{
+	float x = octahedral[0];
+	float y = octahedral[1];
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	if(z < 0.0f)
+	{
+		float unfoldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float unfoldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+
+	float length = sqrtf(x * x + y * y + z * z);
+	normal[0] = x / length;
+	normal[1] = y / length;
+	normal[2] = z / length;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+
+// Conversions behind the compact vertex format.
+
+// IEEE 754 half precision, rounded to nearest even. Out of range values become infinity.
+uint16_t    floatToHalf(float value);
+float       halfToFloat(uint16_t value);
+
+// Maps [-1,1] to a signed normalized integer with the given number of bits (8 or 16).
+int         quantizeSnorm(float value, int bits);
+float       dequantizeSnorm(int value, int bits);
+
+// Octahedral mapping of unit vectors to [-1,1]^2: the sphere is projected onto an
+// octahedron, whose lower half is folded over the upper one. Errors are spread much
+// more evenly than with two angles, so few bits go a long way.
+void        encodeOctahedral(const float *normal, float *octahedral);
+void        decodeOctahedral(const float *octahedral, float *normal);
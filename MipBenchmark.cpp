@@ -0,0 +1,98 @@
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
+// Needed on MsWindows
+#include <windows.h>
+#endif // Win32 platform
+
+#include <GL/gl.h>
+#include <GL/glu.h>
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "MipBenchmark.h"
+#include "ImageDecoder.h"
+#include "TextureMips.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static GLenum getFormat(int components)
+{
+	static const GLenum formats[] = { GL_LUMINANCE, GL_LUMINANCE_ALPHA, GL_RGB, GL_RGBA };
+	return formats[components - 1];
+}
+
+// the whole chain from downsampleMip, returns the milliseconds spent filtering
+static double buildOwnMips(const DecodedImage& image, std::vector<unsigned char>& levels)
+{
+	GLenum format = getFormat(image.components);
+	int levelCount = getMipLevelCount(image.width, image.height);
+	int width = image.width, height = image.height;
+	const unsigned char* source = image.pixels;
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, source);
+
+	double filtering = 0;
+	levels.resize((size_t)image.width * image.height * image.components);
+	for(int level = 1; level < levelCount; level++)
+	{
+		Clock::time_point start = Clock::now();
+		unsigned char* destination = &levels[level % 2 ? 0 : levels.size() / 2];
+		downsampleMip(source, width, height, image.components, destination);
+		filtering += millisecondsSince(start);
+
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		glTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, format, GL_UNSIGNED_BYTE, destination);
+		source = destination;
+	}
+	return filtering;
+}
+
+void runMipBenchmark(const char* const *filenames, int count)
+{
+	const int iterations = 20;
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	printf("%-12s %11s %10s %10s %10s\n", "image", "size", "GLU ms", "ours ms", "filter ms");
+	for(int i = 0; i < count; i++)
+	{
+		DecodedImage image;
+		if(!ImageDecoder::decode(filenames[i], image))
+		{
+			printf("%-12s cannot be decoded\n", filenames[i]);
+			continue;
+		}
+
+		GLenum format = getFormat(image.components);
+		glFinish();
+		Clock::time_point start = Clock::now();
+		for(int iteration = 0; iteration < iterations; iteration++)
+			gluBuild2DMipmaps(GL_TEXTURE_2D, format, image.width, image.height, format, GL_UNSIGNED_BYTE, image.pixels);
+		glFinish();
+		double glu = millisecondsSince(start) / iterations;
+
+		std::vector<unsigned char> levels;
+		double filtering = 0;
+		start = Clock::now();
+		for(int iteration = 0; iteration < iterations; iteration++)
+			filtering += buildOwnMips(image, levels);
+		glFinish();
+		double own = millisecondsSince(start) / iterations;
+
+		printf("%-12s %5dx%-5d %10.3f %10.3f %10.3f\n", filenames[i], image.width, image.height, glu, own, filtering / iterations);
+		ImageDecoder::release(image);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glDeleteTextures(1, &texture);
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Times downsampleMip against gluBuild2DMipmaps on the given images and prints the
+// results. Both include the upload of every level. Needs a current GL context.
+void    runMipBenchmark(const char* const *filenames, int count);
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "ParticleBenchmark.h"
+#include "ParticleKernels.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// every component of count particles, filled the same way for each kernel
+struct  ParticleData
+{
+	std::vector<float>  floats[8];
+	std::vector<int>    ages;
+
+	ParticleData(size_t count) : ages(count)
+	{
+		srand(1);
+		for(int component = 0; component < 8; component++)
+		{
+			floats[component].resize(count);
+			for(size_t i = 0; i < count; i++)
+				floats[component][i] = (float)(rand() % 2000) * 0.01f - 10.0f;
+		}
+	}
+
+	ParticleKernels::Arrays getArrays()
+	{
+		ParticleKernels::Arrays arrays = {
+			&floats[0][0], &floats[1][0], &floats[2][0], &floats[3][0],
+			&floats[4][0], &floats[5][0], &floats[6][0], &floats[7][0], &ages[0],
+		};
+		return arrays;
+	}
+
+	bool operator==(const ParticleData& o) const
+	{
+		for(int component = 0; component < 8; component++)
+		{
+			if(memcmp(&floats[component][0], &o.floats[component][0], floats[component].size() * sizeof(float)) != 0)
+				return false;
+		}
+		return ages == o.ages;
+	}
+};
+
+void runParticleBenchmark()
+{
+	const size_t counts[] = { 1000, 100000, 1000000 };
+	// enough updates at every size that the timing is not all clock resolution
+	const double updatedParticles = 2e8;
+	const float dt = 1.0f / 60.0f;
+
+	printf("best kernel: %s\n", ParticleKernels::getName(ParticleKernels::getBest()));
+	printf("%-8s %10s %10s %14s %8s %8s\n", "kernel", "particles", "updates", "particles/s", "speedup", "matches");
+	for(size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+	{
+		int updates = (int)(updatedParticles / counts[c]);
+		ParticleData reference(counts[c]);
+		double scalarRate = 0;
+		for(int kernel = 0; kernel < ParticleKernels::KERNEL_COUNT; kernel++)
+		{
+			if(!ParticleKernels::isSupported((ParticleKernels::Kernel)kernel))
+			{
+				printf("%-8s %10u not supported\n", ParticleKernels::getName((ParticleKernels::Kernel)kernel), (unsigned int)counts[c]);
+				continue;
+			}
+
+			ParticleData data(counts[c]);
+			ParticleKernels::Arrays arrays = data.getArrays();
+			Clock::time_point start = Clock::now();
+			for(int update = 0; update < updates; update++)
+				ParticleKernels::update((ParticleKernels::Kernel)kernel, arrays, counts[c], dt);
+			double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			double rate = (double)counts[c] * updates / seconds;
+
+			// the scalar kernel runs first and leaves the results the others are checked against
+			if(kernel == ParticleKernels::SCALAR)
+			{
+				reference = data;
+				scalarRate = rate;
+			}
+			printf("%-8s %10u %10d %14.0f %7.2fx %8s\n", ParticleKernels::getName((ParticleKernels::Kernel)kernel), (unsigned int)counts[c],
+				updates, rate, rate / scalarRate, data == reference ? "yes" : "no");
+		}
+	}
+}
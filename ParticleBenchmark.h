@@ -0,0 +1,5 @@
+#pragma once
+
+// Times every particle update kernel the CPU supports on 1k, 100k and 1M particles,
+// checks each against the scalar reference and prints particles per second.
+void    runParticleBenchmark();
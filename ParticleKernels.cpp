@@ -0,0 +1,182 @@
+#include "ParticleKernels.h"
+
+// SSE2 is part of every x86-64 target, 32 bit builds only use it when asked to
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PARTICLE_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 is compiled for that one function without raising the target of the whole file,
+// whether the CPU has it is only known at runtime
+#if defined(PARTICLE_KERNELS_SSE2) && (defined(_MSC_VER) || defined(__GNUC__))
+#define PARTICLE_KERNELS_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#include <cpuid.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+static const float sizeGrowth = 0.01f;
+static const float opacityFade = 0.1f;
+static const float velocityDecay = 0.01f;
+
+// particles first..count, the tails the SIMD kernels leave over run through here as well
+static void updateScalar(const ParticleKernels::Arrays& p, size_t first, size_t count, float dt)
+{
+	for(size_t i = first; i < count; i++)
+	{
+		p.positionX[i] += p.velocityX[i] * dt;
+		p.positionY[i] += p.velocityY[i] * dt;
+		p.positionZ[i] += p.velocityZ[i] * dt;
+		p.velocityY[i] -= velocityDecay;
+		p.sizes[i] += sizeGrowth;
+		p.opacities[i] -= opacityFade;
+		p.ages[i]++;
+	}
+}
+
+#ifdef PARTICLE_KERNELS_SSE2
+static void updateSse2(const ParticleKernels::Arrays& p, size_t count, float dt)
+{
+	const __m128 step = _mm_set1_ps(dt);
+	const __m128 growth = _mm_set1_ps(sizeGrowth);
+	const __m128 fade = _mm_set1_ps(opacityFade);
+	const __m128 decay = _mm_set1_ps(velocityDecay);
+	const __m128i one = _mm_set1_epi32(1);
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 velocityY = _mm_loadu_ps(p.velocityY + i);
+		_mm_storeu_ps(p.positionX + i, _mm_add_ps(_mm_loadu_ps(p.positionX + i), _mm_mul_ps(_mm_loadu_ps(p.velocityX + i), step)));
+		_mm_storeu_ps(p.positionY + i, _mm_add_ps(_mm_loadu_ps(p.positionY + i), _mm_mul_ps(velocityY, step)));
+		_mm_storeu_ps(p.positionZ + i, _mm_add_ps(_mm_loadu_ps(p.positionZ + i), _mm_mul_ps(_mm_loadu_ps(p.velocityZ + i), step)));
+		_mm_storeu_ps(p.velocityY + i, _mm_sub_ps(velocityY, decay));
+		_mm_storeu_ps(p.sizes + i, _mm_add_ps(_mm_loadu_ps(p.sizes + i), growth));
+		_mm_storeu_ps(p.opacities + i, _mm_sub_ps(_mm_loadu_ps(p.opacities + i), fade));
+		_mm_storeu_si128((__m128i*)(p.ages + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(p.ages + i)), one));
+	}
+	updateScalar(p, i, count, dt);
+}
+#endif
+
+#ifdef PARTICLE_KERNELS_AVX2
+AVX2_TARGET static void updateAvx2(const ParticleKernels::Arrays& p, size_t count, float dt)
+{
+	const __m256 step = _mm256_set1_ps(dt);
+	const __m256 growth = _mm256_set1_ps(sizeGrowth);
+	const __m256 fade = _mm256_set1_ps(opacityFade);
+	const __m256 decay = _mm256_set1_ps(velocityDecay);
+	const __m256i one = _mm256_set1_epi32(1);
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256 velocityY = _mm256_loadu_ps(p.velocityY + i);
+		_mm256_storeu_ps(p.positionX + i, _mm256_add_ps(_mm256_loadu_ps(p.positionX + i), _mm256_mul_ps(_mm256_loadu_ps(p.velocityX + i), step)));
+		_mm256_storeu_ps(p.positionY + i, _mm256_add_ps(_mm256_loadu_ps(p.positionY + i), _mm256_mul_ps(velocityY, step)));
+		_mm256_storeu_ps(p.positionZ + i, _mm256_add_ps(_mm256_loadu_ps(p.positionZ + i), _mm256_mul_ps(_mm256_loadu_ps(p.velocityZ + i), step)));
+		_mm256_storeu_ps(p.velocityY + i, _mm256_sub_ps(velocityY, decay));
+		_mm256_storeu_ps(p.sizes + i, _mm256_add_ps(_mm256_loadu_ps(p.sizes + i), growth));
+		_mm256_storeu_ps(p.opacities + i, _mm256_sub_ps(_mm256_loadu_ps(p.opacities + i), fade));
+		// 8 lane integer adds are the part that needs AVX2 rather than AVX
+		_mm256_storeu_si256((__m256i*)(p.ages + i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(p.ages + i)), one));
+	}
+	_mm256_zeroupper();
+	updateScalar(p, i, count, dt);
+}
+
+static void cpuid(int leaf, int subleaf, unsigned int registers[4])
+{
+#if defined(_MSC_VER)
+	__cpuidex((int*)registers, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// the CPU has to have AVX2, and the OS has to save the upper halves of the ymm registers
+static bool detectAvx2()
+{
+	unsigned int registers[4];
+	cpuid(0, 0, registers);
+	if(registers[0] < 7)
+		return false;
+	cpuid(1, 0, registers);
+	const unsigned int osxsave = 1u << 27, avx = 1u << 28;
+	if((registers[2] & (osxsave | avx)) != (osxsave | avx))
+		return false;
+#if defined(_MSC_VER)
+	unsigned long long xcr0 = _xgetbv(0);
+#else
+	unsigned int xcr0Low, xcr0High;
+	__asm__ volatile("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+	unsigned long long xcr0 = ((unsigned long long)xcr0High << 32) | xcr0Low;
+#endif
+	// xmm and ymm state
+	if((xcr0 & 6) != 6)
+		return false;
+	cpuid(7, 0, registers);
+	return (registers[1] & (1u << 5)) != 0;
+}
+#endif
+
+bool ParticleKernels::isSupported(Kernel kernel)
+{
+	switch(kernel)
+	{
+	case SCALAR:
+		return true;
+#ifdef PARTICLE_KERNELS_SSE2
+	case SSE2:
+		return true;
+#endif
+#ifdef PARTICLE_KERNELS_AVX2
+	case AVX2:
+		{
+			static const bool avx2 = detectAvx2();
+			return avx2;
+		}
+#endif
+	default:
+		return false;
+	}
+}
+
+ParticleKernels::Kernel ParticleKernels::getBest()
+{
+	static const Kernel best = isSupported(AVX2) ? AVX2 : isSupported(SSE2) ? SSE2 : SCALAR;
+	return best;
+}
+
+const char* ParticleKernels::getName(Kernel kernel)
+{
+	static const char* names[KERNEL_COUNT] = { "scalar", "sse2", "avx2" };
+	return kernel < KERNEL_COUNT ? names[kernel] : "unknown";
+}
+
+void ParticleKernels::update(Kernel kernel, const Arrays& particles, size_t count, float dt)
+{
+	switch(kernel)
+	{
+#ifdef PARTICLE_KERNELS_AVX2
+	case AVX2:
+		updateAvx2(particles, count, dt);
+		return;
+#endif
+#ifdef PARTICLE_KERNELS_SSE2
+	case SSE2:
+		updateSse2(particles, count, dt);
+		return;
+#endif
+	default:
+		updateScalar(particles, 0, count, dt);
+	}
+}
+
+void ParticleKernels::update(const Arrays& particles, size_t count, float dt)
+{
+	update(getBest(), particles, count, dt);
+}
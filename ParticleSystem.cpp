@@ -0,0 +1,86 @@
+#include <stdlib.h>
+
+#include "ParticleSystem.h"
+#include "ParticleKernels.h"
+#include "float4.h"
+
+ParticleSystem::ParticleSystem(size_t capacity, float floor) : capacity(capacity), count(0),
+	positionX(capacity), positionY(capacity), positionZ(capacity),
+	velocityX(capacity), velocityY(capacity), velocityZ(capacity),
+	sizes(capacity), opacities(capacity), ages(capacity), floor(floor)
+{
+}
+
+bool ParticleSystem::spawn(const float3& position, const float3& velocity, float size)
+{
+	if(count == capacity)
+		return false;
+	positionX[count] = position.x;
+	positionY[count] = position.y;
+	positionZ[count] = position.z;
+	velocityX[count] = velocity.x;
+	velocityY[count] = velocity.y;
+	velocityZ[count] = velocity.z;
+	sizes[count] = size;
+	opacities[count] = 1.0f;
+	ages[count] = 0;
+	count++;
+	return true;
+}
+
+// the spread the dust billboards had: whole units of velocity from -5 to 4 on every axis
+void ParticleSystem::emitDust(const float3& position, unsigned int count)
+{
+	for(unsigned int i = 0; i < count; i++)
+	{
+		float3 velocity((float)(rand() % 10 - 5), (float)(rand() % 10 - 5), (float)(rand() % 10 - 5));
+		if(!spawn(position - float3(0.5f, 0.5f, 0.5f), velocity, 7.0f))
+			break;
+	}
+}
+
+void ParticleSystem::remove(size_t i)
+{
+	count--;
+	positionX[i] = positionX[count];
+	positionY[i] = positionY[count];
+	positionZ[i] = positionZ[count];
+	velocityX[i] = velocityX[count];
+	velocityY[i] = velocityY[count];
+	velocityZ[i] = velocityZ[count];
+	sizes[i] = sizes[count];
+	opacities[i] = opacities[count];
+	ages[i] = ages[count];
+}
+
+void ParticleSystem::update(float dt)
+{
+	if(count == 0)
+		return;
+
+	ParticleKernels::Arrays particles = {
+		&positionX[0], &positionY[0], &positionZ[0],
+		&velocityX[0], &velocityY[0], &velocityZ[0],
+		&sizes[0], &opacities[0], &ages[0],
+	};
+	ParticleKernels::update(particles, count, dt);
+
+	float* py = &positionY[0];
+	// the moved in particle is checked again before going on
+	for(size_t i = 0; i < count;)
+	{
+		if(py[i] < floor)
+			remove(i);
+		else
+			i++;
+	}
+}
+
+void ParticleSystem::draw(BillboardBatch& batch, const float3& xAxis, const float3& yAxis, const TextureAtlas::Sprite& sprite) const
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		float3 position(positionX[i], positionY[i], positionZ[i]);
+		batch.add(position, xAxis * sizes[i], yAxis * sizes[i], sprite, float4(0, 0, opacities[i], opacities[i]));
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+#include "BillboardBatch.h"
+#include "TextureAtlas.h"
+#include "float3.h"
+
+// Fixed capacity particles kept as one array per component, so update() runs through
+// them 4 or 8 at a time with the widest of ParticleKernels the CPU has. Dead particles
+// are replaced by the last live one, which keeps the live ones packed at the front but
+// does not keep their order.
+class   ParticleSystem
+{
+	size_t              capacity;
+	size_t              count;
+
+	std::vector<float>  positionX, positionY, positionZ;
+	std::vector<float>  velocityX, velocityY, velocityZ;
+	std::vector<float>  sizes;
+	std::vector<float>  opacities;
+	std::vector<int>    ages;           // in updates
+
+	float               floor;          // particles that fall below this height are removed
+
+	void        remove(size_t i);
+
+public:
+	ParticleSystem(size_t capacity, float floor);
+
+	// false when all capacity particles are alive, then nothing is spawned
+	bool        spawn(const float3& position, const float3& velocity, float size);
+	// a burst of count particles at position, as many as fit
+	void        emitDust(const float3& position, unsigned int count);
+
+	// per update, whatever dt is: particles grow by 0.01, fade by 0.1 and
+	// their vertical velocity drops by 0.01; positions move by velocity * dt
+	void        update(float dt);
+
+	// quads from position -xAxis -yAxis to +xAxis +yAxis scaled by each particle's size,
+	// colored 0, 0, opacity, opacity
+	void        draw(BillboardBatch& batch, const float3& xAxis, const float3& yAxis, const TextureAtlas::Sprite& sprite) const;
+
+	size_t      size() const { return count; }
+	size_t      getCapacity() const { return capacity; }
+};
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <vector>
+
+#include "Residency.h"
+
+static std::vector<Resident*>   residents;
+static size_t                   budget = 0;
+static unsigned int             frame = 0;
+static unsigned int             reductions = 0;
+
+Resident::Resident(Kind kind) : kind(kind), lastUsed(frame)
+{
+	residents.push_back(this);
+}
+
+Resident::~Resident()
+{
+	residents.erase(std::find(residents.begin(), residents.end(), this));
+}
+
+void Resident::markUsed()
+{
+	lastUsed = frame;
+}
+
+void Residency::setBudget(size_t bytes)
+{
+	budget = bytes;
+}
+
+size_t Residency::getBudget()
+{
+	return budget;
+}
+
+bool Residency::isOverBudget()
+{
+	return budget != 0 && getResidentBytes() > budget;
+}
+
+size_t Residency::getResidentBytes()
+{
+	size_t bytes = 0;
+	for(size_t i = 0; i < residents.size(); i++)
+		bytes += residents[i]->getResidentBytes();
+	return bytes;
+}
+
+size_t Residency::getResidentBytes(Resident::Kind kind)
+{
+	size_t bytes = 0;
+	for(size_t i = 0; i < residents.size(); i++)
+	{
+		if(residents[i]->kind == kind)
+			bytes += residents[i]->getResidentBytes();
+	}
+	return bytes;
+}
+
+void Residency::nextFrame()
+{
+	frame++;
+}
+
+unsigned int Residency::getFrame()
+{
+	return frame;
+}
+
+static bool usedEarlier(const Resident* a, const Resident* b)
+{
+	return a->getLastUsed() < b->getLastUsed();
+}
+
+void Residency::reduceDetail()
+{
+	if(!isOverBudget())
+		return;
+
+	std::vector<Resident*> byAge(residents);
+	std::stable_sort(byAge.begin(), byAge.end(), usedEarlier);
+	size_t bytes = getResidentBytes();
+	for(bool reduced = true; reduced && bytes > budget;)
+	{
+		reduced = false;
+		for(size_t i = 0; i < byAge.size() && bytes > budget; i++)
+		{
+			size_t before = byAge[i]->getResidentBytes();
+			if(!byAge[i]->reduceResidency())
+				continue;
+			size_t after = byAge[i]->getResidentBytes();
+			bytes = bytes - before + after;
+			reduced = reduced || after < before;
+			if(after < before)
+				reductions++;
+		}
+	}
+}
+
+unsigned int Residency::getReductions()
+{
+	return reductions;
+}
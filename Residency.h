@@ -0,0 +1,52 @@
+#pragma once
+#include <stddef.h>
+
+// GPU memory held by one asset. Every Resident is known to Residency for its whole life,
+// which only ever runs on the render thread.
+class   Resident
+{
+	friend class Residency;
+
+	int             kind;
+	unsigned int    lastUsed;       // Residency frame of the last draw
+
+public:
+	enum Kind { TEXTURE, MESH, KIND_COUNT };
+
+	Resident(Kind kind);
+	virtual ~Resident();
+
+	// call whenever the asset is drawn
+	void            markUsed();
+	unsigned int    getLastUsed() const { return lastUsed; }
+
+	virtual size_t  getResidentBytes() const = 0;
+	// frees some GPU memory and keeps the asset drawable, such as by dropping the top
+	// mip level of a texture; false when there is nothing left to drop
+	virtual bool    reduceResidency() { return false; }
+};
+
+// Totals and a budget for the GPU memory of all Residents. Assets nobody references
+// are evicted by their AssetRegistry, least recently used first; when that is not
+// enough, reduceDetail() makes the assets still in use smaller.
+class   Residency
+{
+public:
+	// 0 for no limit
+	static void     setBudget(size_t bytes);
+	static size_t   getBudget();
+	static bool     isOverBudget();
+
+	static size_t   getResidentBytes();
+	static size_t   getResidentBytes(Resident::Kind kind);
+
+	// call once a frame, Resident::markUsed() stamps the current frame
+	static void     nextFrame();
+	static unsigned int getFrame();
+
+	// one reduceResidency() per asset and round, least recently used first,
+	// until the budget is met or nothing can be reduced any further
+	static void     reduceDetail();
+	// reduceResidency() calls that freed memory
+	static unsigned int getReductions();
+};
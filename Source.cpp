@@ -1,6 +1,7 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
 // Needed on MsWindows
@@ -15,15 +16,44 @@
 #include "float2.h"
 #include "float3.h"
 #include "Mesh.h"
-#include "stb_image.h"
+#include "GLExtensions.h"
+#include "AssetLoader.h"
+#include "AssetRegistry.h"
+#include "ImageDecoder.h"
+#include "MappedFile.h"
+#include "TextureCache.h"
+#include "TextureAtlas.h"
+#include "TextureUploads.h"
+#include "Residency.h"
+#include "GLState.h"
+#include "InstanceRenderer.h"
+#include "BillboardBatch.h"
+#include "ParticleSystem.h"
+#include "MipBenchmark.h"
+#include "DecodeBenchmark.h"
+#include "InflateFuzz.h"
+#include "MeshBenchmark.h"
+#include "ParticleBenchmark.h"
 #include <vector>
 #include <map>
+#include <string>
 #include <algorithm>
 
 float3 GRAVITY(0, -9.81, 0);
 int window_id;
 std::vector<bool> keysPressed;
 
+// glutMainLoop never returns, the game ends here: the loader threads, the staging ring
+// and the instance program go while there is still a context, the rest goes with it
+void quit() {
+	AssetLoader::stop();
+	TextureUploads::stop();
+	InstanceRenderer::stop();
+	glutDestroyWindow(window_id);
+	GLState::contextDestroyed();
+	exit(0);
+}
+
 void addParticles(float3);
 
 class LightSource
@@ -48,15 +78,15 @@ public:
 	void   apply(GLenum openglLightName)
 	{
 		float aglPos[] = { dir.x, dir.y, dir.z, 0.0f };
-		glLightfv(openglLightName, GL_POSITION, aglPos);
+		GLState::light(openglLightName, GL_POSITION, aglPos);
 		float aglZero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-		glLightfv(openglLightName, GL_AMBIENT, aglZero);
+		GLState::light(openglLightName, GL_AMBIENT, aglZero);
 		float aglIntensity[] = { radiance.x, radiance.y, radiance.z, 1.0f };
-		glLightfv(openglLightName, GL_DIFFUSE, aglIntensity);
-		glLightfv(openglLightName, GL_SPECULAR, aglIntensity);
-		glLightf(openglLightName, GL_CONSTANT_ATTENUATION, 1.0f);
-		glLightf(openglLightName, GL_LINEAR_ATTENUATION, 0.0f);
-		glLightf(openglLightName, GL_QUADRATIC_ATTENUATION, 0.0f);
+		GLState::light(openglLightName, GL_DIFFUSE, aglIntensity);
+		GLState::light(openglLightName, GL_SPECULAR, aglIntensity);
+		GLState::light(openglLightName, GL_CONSTANT_ATTENUATION, 1.0f);
+		GLState::light(openglLightName, GL_LINEAR_ATTENUATION, 0.0f);
+		GLState::light(openglLightName, GL_QUADRATIC_ATTENUATION, 0.0f);
 	}
 };
 
@@ -73,15 +103,15 @@ public:
 	void   apply(GLenum openglLightName)
 	{
 		float aglPos[] = { pos.x, pos.y, pos.z, 1.0f };
-		glLightfv(openglLightName, GL_POSITION, aglPos);
+		GLState::light(openglLightName, GL_POSITION, aglPos);
 		float aglZero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-		glLightfv(openglLightName, GL_AMBIENT, aglZero);
+		GLState::light(openglLightName, GL_AMBIENT, aglZero);
 		float aglIntensity[] = { power.x, power.y, power.z, 1.0f };
-		glLightfv(openglLightName, GL_DIFFUSE, aglIntensity);
-		glLightfv(openglLightName, GL_SPECULAR, aglIntensity);
-		glLightf(openglLightName, GL_CONSTANT_ATTENUATION, 0.0f);
-		glLightf(openglLightName, GL_LINEAR_ATTENUATION, 0.0f);
-		glLightf(openglLightName, GL_QUADRATIC_ATTENUATION, 0.25f / 3.14f);
+		GLState::light(openglLightName, GL_DIFFUSE, aglIntensity);
+		GLState::light(openglLightName, GL_SPECULAR, aglIntensity);
+		GLState::light(openglLightName, GL_CONSTANT_ATTENUATION, 0.0f);
+		GLState::light(openglLightName, GL_LINEAR_ATTENUATION, 0.0f);
+		GLState::light(openglLightName, GL_QUADRATIC_ATTENUATION, 0.25f / 3.14f);
 	}
 };
 
@@ -97,65 +127,208 @@ public:
 		ks = float3(1, 1, 1);
 		shininess = 15;
 	}
+	virtual ~Material() {}
 	virtual void apply()
 	{
-		glDisable(GL_TEXTURE_2D);
+		GLState::disable(GL_TEXTURE_2D);
 		float aglDiffuse[] = { kd.x, kd.y, kd.z, 1.0f };
-		glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, aglDiffuse);
+		GLState::material(GL_DIFFUSE, aglDiffuse);
 		float aglSpecular[] = { kd.x, kd.y, kd.z, 1.0f };
-		glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, aglSpecular);
+		GLState::material(GL_SPECULAR, aglSpecular);
 		if (shininess <= 128)
-			glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, shininess);
+			GLState::material(GL_SHININESS, shininess);
 		else
-			glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, 128.0f);
+			GLState::material(GL_SHININESS, 128.0f);
 	}
 };
 
-class TexturedMaterial : public Material
+// decoded on a loader thread, untextured until the upload is done
+class TexturedMaterial : public Material, public AsyncAsset, public Resident
 {
+	std::string filename;
+	// the precompiled texture, either mapped from disk or just built from the image
+	MappedFile* cacheFile;
+	std::vector<char> cache;
+	// the container copied into the staging ring by the loader, if there was room
+	StagedUpload staged;
+	size_t residentBytes;
+	// top mip levels given up to stay within the residency budget
+	uint32_t droppedLevels;
 public:
 	GLuint id;
 	GLint filtering;
-	TexturedMaterial(const char* filename, GLint filtering = GL_LINEAR_MIPMAP_LINEAR) {
-		unsigned char* data;
-		int width;
-		int height;
-		int nComponents = 4;
+	TexturedMaterial(const char* filename, GLint filtering = GL_LINEAR_MIPMAP_LINEAR) : Resident(TEXTURE), filename(filename), cacheFile(NULL), residentBytes(0), droppedLevels(0), id(0), filtering(filtering) {
+		AssetLoader::submit(this);
+	}
 
-		data = stbi_load(filename, &width, &height, &nComponents, 0);
+	~TexturedMaterial() {
+		AssetLoader::cancel(this);
+		TextureUploads::discard(staged);
+		delete cacheFile;
+		if (id != 0 && GLState::hasContext()) {
+			glDeleteTextures(1, &id);
+			GLState::textureDeleted(id);
+		}
+	}
 
-		if (data == NULL) return;
+	void apply() {
+		Material::apply();
+		// untextured until GL has read the texels out of the staging ring
+		if (!isReady() || !TextureUploads::isComplete(staged))
+			return;
+		markUsed();
+		GLState::enable(GL_TEXTURE_2D);
+		GLState::bindTexture(id);
+		GLState::texEnvMode(GL_REPLACE);
+	}
 
-		// opengl texture creation comes here
-		glGenTextures(1, &id);  // id generation
-		glBindTexture(GL_TEXTURE_2D, id);      // binding
+	// texels of every mip level, as uploaded
+	size_t getResidentBytes() const { return residentBytes; }
 
-		if (nComponents == 4)
-			gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGBA, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		else if (nComponents == 3)
-			gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
+	// drops the largest level left, the others are uploaded again from the cache file;
+	// runs on the render thread, but only uploads a quarter of what the texture held
+	bool reduceResidency() {
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		if (!isReady() || !TextureUploads::isComplete(staged) || id == 0 || !getTextureSourceStamp(filename.c_str(), sourceSize, sourceTime))
+			return false;
+		MappedFile file(getTextureCachePath(filename.c_str()).c_str());
+		const TextureCacheHeader* header = checkTextureCache(file.begin(), file.getSize(), sourceSize, sourceTime);
+		if (header == NULL || !takesOwnLevels(header) || droppedLevels + 1 >= header->levelCount)
+			return false;
 
-		delete data;
+		droppedLevels++;
+		glDeleteTextures(1, &id);
+		GLState::textureDeleted(id);
+		createTexture();
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		uploadLevels(header, (const char*)header);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		return true;
 	}
 
-	void apply() {
-		Material::apply();
-		glEnable(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, id);
-		//glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+protected:
+	void loadData() {
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		if (!getTextureSourceStamp(filename.c_str(), sourceSize, sourceTime))
+			return;
+
+		std::string cachePath = getTextureCachePath(filename.c_str());
+		cacheFile = new MappedFile(cachePath.c_str());
+		if (checkTextureCache(cacheFile->begin(), cacheFile->getSize(), sourceSize, sourceTime)) {
+			stage(cacheFile->begin(), cacheFile->getSize());
+			return;
+		}
+		delete cacheFile;
+		cacheFile = NULL;
+
+		// missing or stale, convert the image
+		DecodedImage image;
+		if (ImageDecoder::decode(filename.c_str(), image) && (image.components == 3 || image.components == 4)) {
+			buildTextureCache(image, sourceSize, sourceTime, cache);
+			saveTextureCache(cachePath.c_str(), cache);
+			stage(&cache[0], cache.size());
+		}
+		ImageDecoder::release(image);
+	}
+
+	// copies the whole container into the staging ring, so the level offsets still apply,
+	// and keeps only its header and level table; GLU uploads always come from client memory
+	void stage(const char* container, size_t size) {
+		const TextureCacheHeader* header = (const TextureCacheHeader*)container;
+		if (!takesOwnLevels(header))
+			return;
+		char* region = TextureUploads::reserve(size, staged);
+		if (region == NULL)
+			return;
+		memcpy(region, container, size);
+		std::vector<char> table(container, container + sizeof(TextureCacheHeader) + header->levelCount * sizeof(TextureCacheLevel));
+		cache.swap(table);
+		delete cacheFile;
+		cacheFile = NULL;
+	}
+
+	// filtering is part of the texture object, so it is set once here and not on every apply()
+	void createTexture() {
+		glGenTextures(1, &id);
+		GLState::bindTexture(id);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filtering);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	// GL takes the container's own levels unless it needs power of two sizes and the image is not
+	static bool takesOwnLevels(const TextureCacheHeader* header) {
+		bool powerOfTwo = (header->width & (header->width - 1)) == 0 && (header->height & (header->height - 1)) == 0;
+		return powerOfTwo || GLExtensions::npotTextures;
 	}
 
+	// the levels from droppedLevels on into the bound texture, texels addresses the container's first byte
+	void uploadLevels(const TextureCacheHeader* header, const char* texels) {
+		const TextureCacheLevel* levels = (const TextureCacheLevel*)(header + 1);
+		GLenum format = header->components == 4 ? GL_RGBA : GL_RGB;
+		residentBytes = 0;
+		for (uint32_t level = droppedLevels; level < header->levelCount; level++) {
+			glTexImage2D(GL_TEXTURE_2D, level - droppedLevels, format, levels[level].width, levels[level].height, 0, format, GL_UNSIGNED_BYTE, texels + levels[level].offset);
+			residentBytes += levels[level].size;
+		}
+	}
+
+	void uploadData() {
+		const TextureCacheHeader* header = (const TextureCacheHeader*)(cacheFile != NULL ? cacheFile->begin() : cache.empty() ? NULL : &cache[0]);
+		if (header == NULL) return;
+		const TextureCacheLevel* levels = (const TextureCacheLevel*)(header + 1);
+		GLenum format = header->components == 4 ? GL_RGBA : GL_RGB;
+
+		// opengl texture creation comes here
+		createTexture();
+
+		// the levels have tightly packed rows
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		if (takesOwnLevels(header)) {
+			// from the staging ring GL copies the texels without holding up this thread
+			const char* texels = staged.id != 0 ? TextureUploads::beginUpload(staged) : (const char*)header;
+			uploadLevels(header, texels);
+			if (staged.id != 0)
+				TextureUploads::endUpload(staged);
+		}
+		else {
+			// GL without non power of two textures, GLU rescales the image and filters its own chain
+			gluBuild2DMipmaps(GL_TEXTURE_2D, format, header->width, header->height, format, GL_UNSIGNED_BYTE, (const char*)header + levels[0].offset);
+			for (GLint level = 0;; level++) {
+				GLint levelWidth = 0, levelHeight = 0;
+				glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &levelWidth);
+				glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &levelHeight);
+				if (levelWidth == 0 || levelHeight == 0)
+					break;
+				residentBytes += (size_t)levelWidth * levelHeight * header->components;
+				if (levelWidth == 1 && levelHeight == 1)
+					break;
+			}
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		delete cacheFile;
+		cacheFile = NULL;
+		std::vector<char>().swap(cache);
+	}
 };
 
+// meshes and textured materials are shared by every object that uses the same file
+AssetRegistry<Mesh> meshRegistry;
+AssetRegistry<TexturedMaterial> materialRegistry;
+
+// billboard textures and the shadow, packed so they are drawn without rebinding textures
+enum { SPRITE_GRASS, SPRITE_DUST, SPRITE_SHADOW };
+TextureAtlas* spriteAtlas = NULL;
+
 class Camera
 {
 	friend class Billboard;
-	friend class MovableBillboard;
+	friend class Scene;
 
 	float3 eye;
+	float3 viewPoint;
 
 	float3 ahead;
 	float3 lookAt;
@@ -180,6 +353,7 @@ public:
 	Camera()
 	{
 		eye = float3(0, 100, 0);
+		viewPoint = float3(0, 170, 0);
 		lookAt = float3(0, -1, 0);
 		right = float3(1, 0, 0);
 		up = float3(0, 1, 0);
@@ -195,7 +369,7 @@ public:
 		gluPerspective(fov / 3.14 * 180, aspect, 0.1, 500);
 		glMatrixMode(GL_MODELVIEW);
 		glLoadIdentity();
-		gluLookAt(0, 170, 0, 0, 0, 0, 0.0, 0.0, 1.0);
+		gluLookAt(viewPoint.x, viewPoint.y, viewPoint.z, 0, 0, 0, 0.0, 0.0, 1.0);
 		//gluLookAt(eye.x, eye.y, eye.z, lookAt.x, lookAt.y, lookAt.z, 0.0, 1.0, 0.0);
 		//gluLookAt(eye.x, eye.y, eye.z, -49, 99, -50, 5.0, -5.0, 0.0);
 
@@ -203,6 +377,15 @@ public:
 
 	void setAspectRatio(float ar) { aspect = ar; }
 
+	// share of the view height covered by one unit of length at point
+	float getScreenScale(float3 point)
+	{
+		float distance = (point - viewPoint).norm();
+		if (distance < 0.1)
+			distance = 0.1;
+		return 1 / (2 * distance * tan(fov / 2));
+	}
+
 	void move(float dt, std::vector<bool>& keysPressed)
 	{
 		if (keysPressed.at('w'))
@@ -218,8 +401,7 @@ public:
 		if (keysPressed.at('e'))
 			eye += float3(0, 1, 0) * dt * 20;
 		if (keysPressed.at(27)) {
-			glutDestroyWindow(window_id);
-			exit(0);
+			quit();
 		}
 
 		/*float yaw = atan2f(ahead.x, ahead.z);
@@ -261,7 +443,6 @@ class Object
 {
 protected:
 	Material* material;
-	Material* shadow;
 	float3 scaleFactor;
 	float3 position;
 	float3 orientationAxis;
@@ -269,8 +450,14 @@ protected:
 	float orientationAngle;
 	bool onGround;
 public:
-	Object(Material* material) :material(material), shadow(new TexturedMaterial("dark.png")), orientationAngle(0.0f), scaleFactor(1.0, 1.0, 1.0), orientationAxis(0.0, 1.0, 0.0), position(0, 0, 0), onGround(false) {}
-	virtual ~Object() {}
+	// takes over the caller's registry reference to material
+	Object(Material* material) :material(material), orientationAngle(0.0f), scaleFactor(1.0, 1.0, 1.0), orientationAxis(0.0, 1.0, 0.0), position(0, 0, 0), onGround(false) {}
+	Object(const Object& other) :material(other.material), scaleFactor(other.scaleFactor), position(other.position), orientationAxis(other.orientationAxis), velocity(other.velocity), orientationAngle(other.orientationAngle), onGround(other.onGround) {
+		materialRegistry.retain(dynamic_cast<TexturedMaterial*>(material));
+	}
+	virtual ~Object() {
+		materialRegistry.release(dynamic_cast<TexturedMaterial*>(material));
+	}
 	float3 getPosition() {
 		return position;
 	}
@@ -293,7 +480,21 @@ public:
 	Object* rotate(float angle) {
 		orientationAngle += angle; return this;
 	}
-	virtual void draw()
+	// the scaling, orientation and translation draw() applies, as a row vector matrix
+	float4x4 getModelMatrix() {
+		return float4x4::scaling(scaleFactor) * float4x4::rotation(orientationAxis, orientationAngle / 180 * 3.14159265f) * float4x4::translation(position);
+	}
+	// the flattened transform drawShadow() applies, shrinking as the object rises
+	float4x4 getShadowMatrix() {
+		float3 shadowScale(scaleFactor.x - (position.y / 200), 0, scaleFactor.z - (position.y / 200));
+		return float4x4::scaling(shadowScale) * float4x4::rotation(orientationAxis, orientationAngle / 180 * 3.14159265f) * float4x4::translation(float3(position.x, 0.1, position.z));
+	}
+	bool hasShadow() {
+		return position.y > -1;
+	}
+	// world space bounds, false for objects without a mesh
+	virtual bool getWorldBounds(Mesh::Bounds& /*bounds*/) { return false; }
+	virtual void draw(Camera& /*camera*/)
 	{
 		material->apply();
 		// apply scaling, translation and orientation
@@ -308,9 +509,11 @@ public:
 	virtual void drawModel() = 0;
 	virtual void drawShadow(float3 lightDir) 
 	{
-		if (position.y > -1) {
+		if (hasShadow()) {
 			// apply scaling, translation and orientation
-			shadow->apply();
+			// the model's own texture coordinates are mapped onto the shadow sprite
+			spriteAtlas->apply();
+			spriteAtlas->loadSpriteMatrix(SPRITE_SHADOW);
 			glColor3f(0, 0, 0);
 			glMatrixMode(GL_MODELVIEW);
 			glColor3f(0, 0, 0);
@@ -322,6 +525,7 @@ public:
 			drawModel();
 			glColor3f(0, 0, 0);
 			glPopMatrix();
+			TextureAtlas::resetSpriteMatrix();
 		}
 	}
 	virtual void move(double t, double dt) {}
@@ -352,11 +556,50 @@ public:
 class MeshInstance : public Object
 {
 	Mesh* mesh;
+	unsigned int lod;
 public:
-	MeshInstance(Mesh* mesh, Material* material) : mesh(mesh), Object(material) {}
+	MeshInstance(Mesh* mesh, Material* material) : Object(material), mesh(mesh), lod(0) {}
+	MeshInstance(const MeshInstance& other) : Object(other), mesh(other.mesh), lod(other.lod) {
+		meshRegistry.retain(mesh);
+	}
+	~MeshInstance() {
+		meshRegistry.release(mesh);
+	}
+	bool getWorldBounds(Mesh::Bounds& bounds) {
+		bounds = mesh->getBounds().transform(getModelMatrix());
+		return true;
+	}
+	Mesh::Bounds getWorldSubmeshBounds(unsigned int iSubmesh) {
+		return mesh->getSubmeshBounds(iSubmesh).transform(getModelMatrix());
+	}
+	// pick the level of detail from the projected size, the shadow reuses it
+	void selectLod(Camera& camera)
+	{
+		float maxScale = std::max(fabs(scaleFactor.x), std::max(fabs(scaleFactor.y), fabs(scaleFactor.z)));
+		Mesh::Bounds bounds;
+		getWorldBounds(bounds);
+		lod = mesh->selectLod(camera.getScreenScale(bounds.center) * maxScale);
+	}
+	void draw(Camera& camera)
+	{
+		selectLod(camera);
+		Object::draw(camera);
+	}
+	// queues the mesh and its shadow for instanced drawing instead of draw() and drawShadow(),
+	// false if they have to be drawn one by one
+	bool addInstances(Camera& camera, InstanceBatch<Material>& instances, InstanceBatch<Material>& shadows)
+	{
+		if (!InstanceRenderer::isStarted() || !mesh->canDrawInstanced())
+			return false;
+		selectLod(camera);
+		instances.add(mesh, lod, material, getModelMatrix());
+		if (hasShadow())
+			shadows.add(mesh, lod, NULL, getShadowMatrix());
+		return true;
+	}
 	void drawModel()
 	{
-		mesh->draw();
+		mesh->drawLod(lod);
 	}
 };
 
@@ -444,113 +687,35 @@ class Billboard
 {
 public:
 	float3 position;
-	Material* material;
+	unsigned int sprite;	// in spriteAtlas
 	float size;
 	float opacity;
 	int age;
 
-	Billboard(Material* material, float3 position) : position(position), material(material), age(0), size(7), opacity(1)
+	Billboard(unsigned int sprite, float3 position) : position(position), sprite(sprite), age(0), size(7), opacity(1)
 	{
 	}
+	virtual ~Billboard() {}
 
-	virtual void draw(Camera& camera)
+	// the quad spans position -xAxis -yAxis .. position +xAxis +yAxis before scaling by size;
+	// these are the columns of the camera basis as glMultMatrixf used to apply it
+	virtual void getAxes(Camera& camera, float3& xAxis, float3& yAxis)
 	{
-		//glDisable(GL_DEPTH_TEST);
-		glDepthMask(false);
-		glDisable(GL_LIGHTING);
-		//glColor3f(1, 1, 1);
-		material->apply();
-		glEnable(GL_LIGHTING);
-
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glPushMatrix();
-		glTranslatef(position.x, position.y, position.z);
-		float camRotation[] = {
-			camera.right.x, camera.up.x, camera.ahead.x, 0,
-			camera.right.y, camera.up.y, camera.ahead.y, 0,
-			camera.right.z, camera.up.z, camera.ahead.z, 0,
-			0, 0, 0, 1
-		};
-		glMultMatrixf(camRotation);
-
-		glBegin(GL_QUADS);
-		glTexCoord2f(0, 0);
-		glVertex3f(-size, -size, 0);
-		glTexCoord2f(1, 0);
-		glVertex3f(size, -size, 0.0);
-		glTexCoord2f(1, 1);
-		glVertex3f(size, size, 0.0);
-		glTexCoord2f(0, 1);
-		glVertex3f(-size, size, 0.0);
-		glEnd();
-
-		glPopMatrix();
-		glDisable(GL_BLEND);
-		glDepthMask(true);
-		//glEnable(GL_DEPTH_TEST);
+		xAxis = float3(camera.right.x, camera.up.x, camera.ahead.x);
+		yAxis = float3(camera.right.y, camera.up.y, camera.ahead.y);
 	}
 
-	virtual void move(double t, double dt) {}
-};
-
-class MovableBillboard : public Billboard
-{
-public:
-	float3 velocity;
-	MovableBillboard(float3 velocity, Billboard* billboard) : Billboard(*billboard), velocity(velocity) {}
-
-	void move(double t, double dt) {
-		position += velocity*dt;
-		age++;
-		size += .01;
-		opacity -= .1;
-		velocity.y -= .01;
-	}
+	virtual float4 getColor() { return float4(1, 1, 1, 1); }
 
-	virtual void draw(Camera& camera)
+	// expands the sprite into the batch, drawn with the others in Scene::draw
+	void draw(Camera& camera, BillboardBatch& batch)
 	{
-		//glDisable(GL_DEPTH_TEST);
-		glDepthMask(false);
-		glDisable(GL_LIGHTING);
-		//glColor3f(1, 1, 1);
-		material->apply();
-		glEnable(GL_LIGHTING);
-
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glPushMatrix();
-		glTranslatef(position.x, position.y, position.z);
-		float camRotation[] = {
-			camera.right.x, camera.up.x, camera.ahead.x, 0,
-			camera.right.y, 1, 1, 0,
-			camera.right.z, camera.up.z, camera.ahead.z, 0,
-			0, 0, 0, 1
-		};
-		glMultMatrixf(camRotation);
-
-		//glClearColor(0, 0, 0, 0);
-
-		glBegin(GL_QUADS);
-		glTexCoord2f(0, 0);
-		glColor4f(0, 0, opacity, opacity);
-		glVertex3f(-size, -size, 0);
-		glTexCoord2f(1, 0);
-		glColor4f(0, 0, opacity, opacity);
-		glVertex3f(size, -size, 0.0);
-		glTexCoord2f(1, 1);
-		glColor4f(0, 0, opacity, opacity);
-		glVertex3f(size, size, 0.0);
-		glTexCoord2f(0, 1);
-		glColor4f(0, 0, opacity, opacity);
-		glVertex3f(-size, size, 0.0);
-		glEnd();
-
-		glPopMatrix();
-		glDisable(GL_BLEND);
-		glDepthMask(true);
-		//glEnable(GL_DEPTH_TEST);
+		float3 xAxis, yAxis;
+		getAxes(camera, xAxis, yAxis);
+		batch.add(position, xAxis * size, yAxis * size, spriteAtlas->getSprite(sprite), getColor());
 	}
+
+	virtual void move(double t, double dt) {}
 };
 
 class Teapot : public Object
@@ -571,6 +736,14 @@ class Scene
 	std::vector<Material*> materials;
 	std::vector<Mesh*> meshes;
 	std::vector<Billboard*> billboards;
+	double lastEviction = 0;
+	// meshes and shadows drawn once all objects are queued, one draw per mesh, level and material
+	InstanceBatch<Material> meshInstances;
+	InstanceBatch<Material> shadowInstances;
+	// every billboard uses the sprite atlas and the same blending, so they are a single batch
+	BillboardBatch billboardBatch;
+	// dust kicked up by landings, removed once it falls below the ground like billboards
+	ParticleSystem dust = ParticleSystem(1 << 17, -10);
 
 	struct CameraDepthComparator {
 		float3 ahead;
@@ -586,6 +759,8 @@ public:
 	void initialize()
 	{
 		// BUILD YOUR SCENE HERE
+		const char* sprites[] = { "grass.png", "dust.png", "dark.png" };
+		spriteAtlas = new TextureAtlas(std::vector<std::string>(sprites, sprites + sizeof(sprites) / sizeof(sprites[0])));
 		lightSources.push_back(
 			new DirectionalLight(
 				float3(0, 1, 0),
@@ -604,13 +779,15 @@ public:
 		materials.push_back(new Material());
 		materials.push_back(new Material());
 
-		objects.push_back(new Ground(new TexturedMaterial("ground.jpg")));
+		objects.push_back(new Ground(materialRegistry.acquire("ground.jpg")));
 		//objects.push_back((new Teapot(yellowDiffuseMaterial))->translate(float3(0, -1, 0)));
 		//objects.push_back((new Teapot(materials.at(2)))->translate(float3(0, 1.2, 0.5))->scale(float3(1.3, 1.3, 1.3)));
 		//objects.push_back((new Teapot(materials.at(1)))->translate(float3(0, -1, -2))->scale(float3(0.5, 0.5, 0.5)));
-		objects.push_back((new Controllable(new Movable(float3(.1, .1, .1), .1, new MeshInstance(new Mesh("truck1.obj"), new TexturedMaterial("humvee.jpg")))))->translate(float3(0,100,0))->scale(float3(2,2,2)));
+		MeshInstance truckModel(meshRegistry.acquire("truck1.obj"), materialRegistry.acquire("humvee.jpg"));
+		Movable truckBody(float3(.1, .1, .1), .1, &truckModel);
+		objects.push_back((new Controllable(&truckBody))->translate(float3(0,100,0))->scale(float3(2,2,2)));
 		for (int i = 0; i < 100; i++)
-			billboards.push_back(new Billboard(new TexturedMaterial("grass.png"), float3((rand() % 190) - 95, .1, (rand() % 190) - 95)));
+			billboards.push_back(new Billboard(SPRITE_GRASS, float3((rand() % 190) - 95, .1, (rand() % 190) - 95)));
 		//meshes.push_back(new Mesh("tigger.obj"));
 
 	}
@@ -634,20 +811,33 @@ public:
 		return camera;
 	}
 
+	size_t getParticleCount()
+	{
+		return dust.size();
+	}
+
 	void draw()
 	{
 		camera.apply();
 		unsigned int iLightSource = 0;
 		for (; iLightSource < lightSources.size(); iLightSource++)
 		{
-			glEnable(GL_LIGHT0 + iLightSource);
+			GLState::enable(GL_LIGHT0 + iLightSource);
 			lightSources.at(iLightSource)->apply(GL_LIGHT0 + iLightSource);
 		}
-		for (; iLightSource < GL_MAX_LIGHTS; iLightSource++)
-			glDisable(GL_LIGHT0 + iLightSource);
+		// GL_MAX_LIGHTS is the name of the limit, not its value; every GL has
+		// at least 8 lights, and those are the ones GLState keeps track of
+		for (; iLightSource < 8; iLightSource++)
+			GLState::disable(GL_LIGHT0 + iLightSource);
 
 		for (unsigned int iObject = 0; iObject < objects.size(); iObject++) {
-			objects.at(iObject)->draw();
+			MeshInstance* instance = dynamic_cast<MeshInstance*>(objects.at(iObject));
+			if (instance == NULL || !instance->addInstances(camera, meshInstances, shadowInstances)) {
+				objects.at(iObject)->draw(camera);
+				GLState::disable(GL_LIGHTING);
+				objects.at(iObject)->drawShadow(lightSources.at(0)->getLightDirAt(float3(0, 0, 0)));
+				GLState::enable(GL_LIGHTING);
+			}
 			if (iObject == 1) {
 				for (unsigned int iObject1 = 2; iObject1 < objects.size(); iObject1++) {
 					//printf("checking");
@@ -657,23 +847,40 @@ public:
 						}
 						else if ((objects.at(iObject)->getPosition().y - objects.at(iObject1)->getPosition().y) < 5) {
 							printf("YOU DIED");
-							glutDestroyWindow(window_id);
-							exit(0);
+							quit();
 						}
 					}
 				}
 			}
-			glDisable(GL_LIGHTING);
-			objects.at(iObject)->drawShadow(lightSources.at(0)->getLightDirAt(float3(0, 0, 0)));
-			glEnable(GL_LIGHTING);
-
 		}
 
+		meshInstances.draw();
+		// the model's own texture coordinates are mapped onto the shadow sprite, as in drawShadow()
+		GLState::disable(GL_LIGHTING);
+		spriteAtlas->apply();
+		spriteAtlas->loadSpriteMatrix(SPRITE_SHADOW);
+		glColor3f(0, 0, 0);
+		shadowInstances.draw();
+		TextureAtlas::resetSpriteMatrix();
+		GLState::enable(GL_LIGHTING);
+
 		for (unsigned int iMesh = 0; iMesh < meshes.size(); iMesh++)
 			meshes.at(iMesh)->draw();
 
 		for (unsigned int iBillboard = 0; iBillboard < billboards.size(); iBillboard++)
-			billboards.at(iBillboard)->draw(camera);
+			billboards.at(iBillboard)->draw(camera, billboardBatch);
+		// the dust quads face the camera only partly, as the dust billboards did
+		float3 dustX(camera.right.x, camera.up.x, camera.ahead.x);
+		float3 dustY(camera.right.y, 1, 1);
+		dust.draw(billboardBatch, dustX, dustY, spriteAtlas->getSprite(SPRITE_DUST));
+		GLState::depthMask(false);
+		spriteAtlas->apply();
+		GLState::enable(GL_LIGHTING);
+		GLState::enable(GL_BLEND);
+		GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		billboardBatch.draw();
+		GLState::disable(GL_BLEND);
+		GLState::depthMask(true);
 
 		objects.erase(std::remove_if(objects.begin(), objects.end(), eraseO), objects.end());
 		billboards.erase(std::remove_if(billboards.begin(), billboards.end(), eraseb), billboards.end());
@@ -681,15 +888,19 @@ public:
 	}	
 
 	static bool eraseO(Object* iObject) {
-		if (iObject->getPosition().y < -10)
+		if (iObject->getPosition().y < -10) {
+			delete iObject;
 			return true;
+		}
 		else
 			return false;
 	}
 
 	static bool eraseb(Billboard* iObject) {
-		if (iObject->position.y < -10)
+		if (iObject->position.y < -10) {
+			delete iObject;
 			return true;
+		}
 		else
 			return false;
 	}
@@ -698,8 +909,17 @@ public:
 	{
 		if (fmod(t, 2) == 0) {
 			//printf("hi");
-			objects.push_back((new Movable(float3(.1, .1, .1), .1, new MeshInstance(new Mesh("tree.obj"), new TexturedMaterial("tree.png"))))->translate(float3((rand()%190)-95, 200, (rand()%190) - 95)));
+			MeshInstance treeModel(meshRegistry.acquire("tree.obj"), materialRegistry.acquire("tree.png"));
+			objects.push_back((new Movable(float3(.1, .1, .1), .1, &treeModel))->translate(float3((rand()%190)-95, 200, (rand()%190) - 95)));
+		}
+
+		// assets nothing has used for a while are dropped, short gaps between users keep them loaded
+		if (t - lastEviction > 10) {
+			meshRegistry.evictUnused();
+			materialRegistry.evictUnused();
+			lastEviction = t;
 		}
+		enforceBudget();
 
 		std::vector<Object*> spawn;
 
@@ -711,16 +931,29 @@ public:
 		for (unsigned int iBillboard = 0; iBillboard < billboards.size(); iBillboard++) {
 			billboards.at(iBillboard)->move(t, dt);
 		}
+		dust.update(dt);
 
 		std::sort(billboards.begin(), billboards.end(), comp);
 	}
 
-	void addParticles(float3 position) {
-		for (int i = 0; i < 50; i++) {
-			//printf("hi");
-			//billboards.push_back(new Billboard(new TexturedMaterial("grass.png"), float3(rand() % (10) - .5, rand() % (10) - .5, rand() % (10) - .5)));
-			billboards.push_back(new MovableBillboard(float3(rand() % (10) - 5, rand() % (10) - 5, rand() % (10) - 5), new Billboard(new TexturedMaterial("dust.png"), float3(position.x + rand() % (1) - .5, position.y + rand() % (1) - .5, position.z + rand() % (1) - .5))));
+	// over the GPU memory budget, assets nobody references go first, the one drawn
+	// longest ago first, then the textures still in use lose their top mip levels
+	void enforceBudget() {
+		while (Residency::isOverBudget()) {
+			Mesh* mesh = meshRegistry.findLeastRecentlyUsed();
+			TexturedMaterial* material = materialRegistry.findLeastRecentlyUsed();
+			if (mesh == NULL && material == NULL)
+				break;
+			if (material == NULL || (mesh != NULL && mesh->getLastUsed() <= material->getLastUsed()))
+				meshRegistry.evict(mesh);
+			else
+				materialRegistry.evict(material);
 		}
+		Residency::reduceDetail();
+	}
+
+	void addParticles(float3 position) {
+		dust.emitDust(position, 50);
 	}
 };
 
@@ -730,11 +963,44 @@ void addParticles(float3 position) {
 	scene.addParticles(position);
 }
 
+bool showTriangleStats = false;
+
 void onDisplay() {
 	glClearColor(0.1f, 0.2f, 0.3f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear screen
 
+	static int frames = 0;
+	static double lastReport = 0;
+	// staging space of uploads GL is done with can be reused
+	TextureUploads::retire();
+	Residency::nextFrame();
+	// finish loaded assets within a slice of the frame, the rest wait for the next one
+	AssetLoader::finishUploads(0.002);
 	scene.draw();
+	frames++;
+
+	double t = glutGet(GLUT_ELAPSED_TIME) * 0.001;
+	if (t - lastReport >= 1) {
+		if (showTriangleStats) {
+			printf("%.0f mesh triangles/frame (LOD %s)\n", (double)Mesh::getTrianglesSubmitted() / frames, Mesh::isLodEnabled() ? "on" : "off");
+			printf("textures: %u loaded, %u hits, %u misses, %.1f KB resident, %.1f KB sprite atlas\n", (unsigned int)materialRegistry.size(),
+				materialRegistry.getHits(), materialRegistry.getMisses(), materialRegistry.getResidentBytes() / 1024.0, spriteAtlas->getResidentBytes() / 1024.0);
+			printf("gpu memory: %.1f MB textures, %.1f MB meshes, %.0f MB budget, %u mip levels dropped\n",
+				Residency::getResidentBytes(Resident::TEXTURE) / 1048576.0, Residency::getResidentBytes(Resident::MESH) / 1048576.0,
+				Residency::getBudget() / 1048576.0, Residency::getReductions());
+			printf("gl state: %.0f calls/frame issued, %.0f filtered\n", (double)GLState::getIssuedCalls() / frames, (double)GLState::getFilteredCalls() / frames);
+			printf("instancing %s: %.0f draws/frame, %.0f instances/frame\n", InstanceRenderer::isStarted() ? "on" : "off",
+				(double)InstanceRenderer::getDrawCalls() / frames, (double)InstanceRenderer::getInstancesDrawn() / frames);
+			printf("billboards: %.0f sprites/frame in %.0f draws, %u dust particles\n", (double)BillboardBatch::getSpritesDrawn() / frames,
+				(double)BillboardBatch::getDrawCalls() / frames, (unsigned int)scene.getParticleCount());
+		}
+		Mesh::resetTrianglesSubmitted();
+		GLState::resetCounters();
+		InstanceRenderer::resetCounters();
+		BillboardBatch::resetCounters();
+		frames = 0;
+		lastReport = t;
+	}
 
 	glutSwapBuffers(); // drawing finished
 }
@@ -755,6 +1021,10 @@ void onIdle()
 void onKeyboard(unsigned char key, int x, int y)
 {
 	keysPressed.at(key) = true;
+	if (key == 'l')
+		Mesh::setLodEnabled(!Mesh::isLodEnabled());
+	if (key == 'p')
+		showTriangleStats = !showTriangleStats;
 }
 
 void onKeyboardUp(unsigned char key, int x, int y)
@@ -783,6 +1053,48 @@ void onReshape(int winWidth, int winHeight)
 }
 
 int main(int argc, char **argv) {
+	// GPU memory kept for textures and meshes, -budget MB changes it, 0 for no limit
+	Residency::setBudget((size_t)256 << 20);
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "-budget") == 0)
+			Residency::setBudget((size_t)atoi(argv[i + 1]) << 20);
+		// -loaderthreads N parses .obj files with N threads, 0 (the default) is one per core
+		if (strcmp(argv[i], "-loaderthreads") == 0)
+			Mesh::setLoaderThreads((unsigned int)atoi(argv[i + 1]));
+	}
+	// -decodebench [images] times the image decoder, needs no window
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-decodebench") == 0) {
+			const char* textures[] = { "ground.jpg", "humvee.jpg", "grass.png", "dark.png", "dust.png", "tree.png", "tigger.png" };
+			if (i + 1 < argc)
+				runDecodeBenchmark(argv + i + 1, argc - i - 1);
+			else
+				runDecodeBenchmark(textures, sizeof(textures) / sizeof(textures[0]));
+			return 0;
+		}
+		// -inflatefuzz [pngs] checks the fast inflate against the original one
+		if (strcmp(argv[i], "-inflatefuzz") == 0) {
+			const char* images[] = { "grass.png", "dark.png", "dust.png", "tree.png", "tigger.png" };
+			if (i + 1 < argc)
+				return runInflateFuzz(argv + i + 1, argc - i - 1) ? 0 : 1;
+			return runInflateFuzz(images, sizeof(images) / sizeof(images[0])) ? 0 : 1;
+		}
+		// -meshbench [objs] times the .obj parser against the old getline/sscanf loader
+		if (strcmp(argv[i], "-meshbench") == 0) {
+			const char* meshes[] = { "box.obj", "car.obj", "tigger.obj", "tree.obj", "truck.obj", "truck1.obj" };
+			if (i + 1 < argc)
+				runMeshBenchmark(argv + i + 1, argc - i - 1);
+			else
+				runMeshBenchmark(meshes, sizeof(meshes) / sizeof(meshes[0]));
+			return 0;
+		}
+		// -particlebench times the particle update kernels, needs no window either
+		if (strcmp(argv[i], "-particlebench") == 0) {
+			runParticleBenchmark();
+			return 0;
+		}
+	}
+
 	glutInit(&argc, argv);						// initialize GLUT
 	glutInitWindowSize(600, 600);				// startup window size 
 	glutInitWindowPosition(100, 100);           // where to put window on screen
@@ -801,10 +1113,26 @@ int main(int argc, char **argv) {
 	glutMouseFunc(onMouse);
 	glutMotionFunc(onMouseMotion);
 
-	glEnable(GL_LIGHTING);
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_NORMALIZE);
+	GLState::enable(GL_LIGHTING);
+	GLState::enable(GL_DEPTH_TEST);
+	GLState::enable(GL_NORMALIZE);
 
+	GLExtensions::load();
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-mipbench") == 0) {
+			const char* textures[] = { "ground.jpg", "humvee.jpg", "grass.png", "dark.png", "dust.png", "tree.png", "tigger.png" };
+			runMipBenchmark(textures, sizeof(textures) / sizeof(textures[0]));
+			return 0;
+		}
+	}
+	// meshes are drawn instanced when GL can, object by object otherwise
+	InstanceRenderer::start();
+	// compact vertices need GL_NORMALIZE, enabled above
+	Mesh::setVertexFormat(Mesh::VERTEX_FORMAT_COMPACT);
+	// texels are staged for upload by the loader threads when GL can read them from a mapped buffer
+	TextureUploads::start(64 << 20);
+	// meshes and textures load in the background and draw as placeholders until then
+	AssetLoader::start(0);
 	scene.initialize();
 	for (int i = 0; i<256; i++)
 		keysPressed.push_back(false);
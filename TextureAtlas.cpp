@@ -0,0 +1,260 @@
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
+// Needed on MsWindows
+#include <windows.h>
+#endif // Win32 platform
+
+#include <GL/gl.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "TextureAtlas.h"
+#include "ImageDecoder.h"
+#include "TextureMips.h"
+#include "GLState.h"
+
+// cells start and end on multiples of the padding, so they stay whole texels down to PADDED_LEVELS
+static const int padding = 1 << TextureAtlas::PADDED_LEVELS;
+static const int maxAtlasSize = 4096;
+
+// one sprite with its padding, rounded up to whole multiples of the padding
+struct  Cell
+{
+	int     sprite;
+	int     width;
+	int     height;
+	int     x;
+	int     y;
+};
+
+static bool tallerCell(const Cell& a, const Cell& b)
+{
+	return a.height != b.height ? a.height > b.height : a.width > b.width;
+}
+
+// fills rows of cells left to right, tallest first; returns the height used
+static int packShelves(std::vector<Cell>& cells, int atlasWidth)
+{
+	int x = 0, y = 0, shelfHeight = 0;
+	for(size_t i = 0; i < cells.size(); i++)
+	{
+		if(x + cells[i].width > atlasWidth)
+		{
+			x = 0;
+			y += shelfHeight;
+			shelfHeight = 0;
+		}
+		cells[i].x = x;
+		cells[i].y = y;
+		x += cells[i].width;
+		shelfHeight = std::max(shelfHeight, cells[i].height);
+	}
+	return y + shelfHeight;
+}
+
+static int nextPowerOfTwo(int size)
+{
+	int power = 1;
+	while(power < size)
+		power *= 2;
+	return power;
+}
+
+// grey and grey alpha images get their grey in all three colors
+static void expandToRgba(const DecodedImage& image, std::vector<unsigned char>& rgba)
+{
+	const int n = image.components;
+	rgba.resize((size_t)image.width * image.height * 4);
+	for(size_t i = 0; i < (size_t)image.width * image.height; i++)
+	{
+		const unsigned char* source = image.pixels + i * n;
+		unsigned char* target = &rgba[i * 4];
+		target[0] = source[0];
+		target[1] = source[n >= 3 ? 1 : 0];
+		target[2] = source[n >= 3 ? 2 : 0];
+		target[3] = n == 2 ? source[1] : n == 4 ? source[3] : 255;
+	}
+}
+
+TextureAtlas::TextureAtlas(const std::vector<std::string>& filenames) : Resident(TEXTURE), filenames(filenames), width(0), height(0), id(0), residentBytes(0)
+{
+	AssetLoader::submit(this);
+}
+
+TextureAtlas::~TextureAtlas()
+{
+	AssetLoader::cancel(this);
+	if(id != 0 && GLState::hasContext())
+	{
+		glDeleteTextures(1, &id);
+		GLState::textureDeleted(id);
+	}
+}
+
+void TextureAtlas::loadData()
+{
+	sprites.assign(filenames.size(), Sprite());
+
+	// every sprite as RGBA with its own mip chain down to PADDED_LEVELS
+	std::vector<std::vector<std::vector<unsigned char> > > spriteLevels(filenames.size());
+	std::vector<int> spriteWidths(filenames.size()), spriteHeights(filenames.size());
+	std::vector<Cell> cells;
+	// all sprites decode at once, on one thread per core
+	std::vector<DecodedImage> images;
+	ImageDecoder::decodeBatch(filenames, images, 0);
+	for(size_t i = 0; i < filenames.size(); i++)
+	{
+		DecodedImage& image = images[i];
+		if(image.pixels)
+		{
+			spriteWidths[i] = image.width;
+			spriteHeights[i] = image.height;
+			std::vector<std::vector<unsigned char> >& levels = spriteLevels[i];
+			levels.resize(PADDED_LEVELS + 1);
+			expandToRgba(image, levels[0]);
+			for(int level = 1, w = image.width, h = image.height; level <= PADDED_LEVELS; level++)
+			{
+				levels[level].resize((size_t)std::max(1, w / 2) * std::max(1, h / 2) * 4);
+				downsampleMip(&levels[level - 1][0], w, h, 4, &levels[level][0]);
+				w = std::max(1, w / 2);
+				h = std::max(1, h / 2);
+			}
+
+			Cell cell = { (int)i, (image.width + 2 * padding + padding - 1) & ~(padding - 1), (image.height + 2 * padding + padding - 1) & ~(padding - 1), 0, 0 };
+			cells.push_back(cell);
+		}
+		ImageDecoder::release(image);
+	}
+	if(cells.empty())
+		return;
+
+	// the smallest power of two atlas the shelves fit in, the squarer one of two the same area
+	std::sort(cells.begin(), cells.end(), tallerCell);
+	int widestCell = 0;
+	for(size_t i = 0; i < cells.size(); i++)
+		widestCell = std::max(widestCell, cells[i].width);
+	int bestWidth = 0, bestHeight = 0;
+	for(int atlasWidth = nextPowerOfTwo(widestCell); atlasWidth <= maxAtlasSize; atlasWidth *= 2)
+	{
+		int atlasHeight = nextPowerOfTwo(packShelves(cells, atlasWidth));
+		if(atlasHeight > maxAtlasSize)
+			continue;
+		size_t area = (size_t)atlasWidth * atlasHeight, bestArea = (size_t)bestWidth * bestHeight;
+		if(bestWidth == 0 || area < bestArea || (area == bestArea && abs(atlasWidth - atlasHeight) < abs(bestWidth - bestHeight)))
+		{
+			bestWidth = atlasWidth;
+			bestHeight = atlasHeight;
+		}
+	}
+	if(bestWidth == 0)
+		return;
+	packShelves(cells, bestWidth);
+
+	int levelCount = getMipLevelCount(bestWidth, bestHeight);
+	levelOffsets.resize(levelCount);
+	size_t size = 0;
+	for(int level = 0; level < levelCount; level++)
+	{
+		levelOffsets[level] = size;
+		size += (size_t)std::max(1, bestWidth >> level) * std::max(1, bestHeight >> level) * 4;
+	}
+	// texels outside every cell are transparent black
+	texels.assign(size, 0);
+
+	for(size_t i = 0; i < cells.size(); i++)
+	{
+		const Cell& cell = cells[i];
+		int spriteWidth = spriteWidths[cell.sprite], spriteHeight = spriteHeights[cell.sprite];
+		Sprite& sprite = sprites[cell.sprite];
+		sprite.u0 = (float)(cell.x + padding) / bestWidth;
+		sprite.v0 = (float)(cell.y + padding) / bestHeight;
+		sprite.u1 = (float)(cell.x + padding + spriteWidth) / bestWidth;
+		sprite.v1 = (float)(cell.y + padding + spriteHeight) / bestHeight;
+
+		// the cell is the sprite with its edges repeated out to the cell's border, on every padded level
+		for(int level = 0; level <= PADDED_LEVELS && level < levelCount; level++)
+		{
+			int levelWidth = bestWidth >> level;
+			int levelPadding = padding >> level;
+			int w = std::max(1, spriteWidth >> level), h = std::max(1, spriteHeight >> level);
+			const unsigned char* source = &spriteLevels[cell.sprite][level][0];
+			unsigned char* target = &texels[levelOffsets[level]];
+			for(int y = 0; y < cell.height >> level; y++)
+			{
+				int sourceY = std::min(std::max(y - levelPadding, 0), h - 1);
+				unsigned char* row = target + ((size_t)((cell.y >> level) + y) * levelWidth + (cell.x >> level)) * 4;
+				for(int x = 0; x < cell.width >> level; x++)
+				{
+					int sourceX = std::min(std::max(x - levelPadding, 0), w - 1);
+					memcpy(row + x * 4, source + ((size_t)sourceY * w + sourceX) * 4, 4);
+				}
+			}
+		}
+	}
+
+	// past the padded levels a sprite is only a few texels, the whole atlas is filtered from there
+	for(int level = PADDED_LEVELS + 1; level < levelCount; level++)
+		downsampleMip(&texels[levelOffsets[level - 1]], std::max(1, bestWidth >> (level - 1)), std::max(1, bestHeight >> (level - 1)), 4, &texels[levelOffsets[level]]);
+
+	width = bestWidth;
+	height = bestHeight;
+}
+
+void TextureAtlas::uploadData()
+{
+	if(texels.empty())
+		return;
+
+	glGenTextures(1, &id);
+	GLState::bindTexture(id);
+	// rgba rows are always 4 byte aligned
+	for(size_t level = 0; level < levelOffsets.size(); level++)
+	{
+		int levelWidth = std::max(1, width >> (int)level), levelHeight = std::max(1, height >> (int)level);
+		glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA, levelWidth, levelHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, &texels[levelOffsets[level]]);
+		residentBytes += (size_t)levelWidth * levelHeight * 4;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	std::vector<unsigned char>().swap(texels);
+}
+
+const TextureAtlas::Sprite& TextureAtlas::getSprite(unsigned int iSprite) const
+{
+	static const Sprite empty = { 0, 0, 0, 0 };
+	if(!isLoaded() || iSprite >= sprites.size())
+		return empty;
+	return sprites[iSprite];
+}
+
+void TextureAtlas::apply()
+{
+	if(!isReady() || id == 0)
+	{
+		GLState::disable(GL_TEXTURE_2D);
+		return;
+	}
+	markUsed();
+	GLState::enable(GL_TEXTURE_2D);
+	GLState::bindTexture(id);
+	GLState::texEnvMode(GL_REPLACE);
+}
+
+void TextureAtlas::loadSpriteMatrix(unsigned int iSprite)
+{
+	const Sprite& sprite = getSprite(iSprite);
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glTranslatef(sprite.u0, sprite.v0, 0);
+	glScalef(sprite.u1 - sprite.u0, sprite.v1 - sprite.v0, 1);
+	glMatrixMode(GL_MODELVIEW);
+}
+
+void TextureAtlas::resetSpriteMatrix()
+{
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "AssetLoader.h"
+#include "Residency.h"
+
+// Small images packed into one RGBA texture, so everything drawn with them can
+// share a single bind. Every sprite sits in its own cell with its edge texels
+// repeated around it, and the first PADDED_LEVELS mip levels are filtered per
+// sprite, so neither bilinear filtering nor mipmapping pulls in texels of a
+// neighbour until a sprite is smaller than 1 / (1 << PADDED_LEVELS) of its size.
+// The atlas is laid out and filtered by AssetLoader, the texture is untextured until then.
+class   TextureAtlas : public AsyncAsset, public Resident
+{
+public:
+	enum { PADDED_LEVELS = 3 };
+
+	// texture coordinates of the corner at the sprite's first texel (u0, v0) and
+	// of the opposite corner, so (0, 0)..(1, 1) over a whole texture maps to u0..u1, v0..v1
+	struct  Sprite
+	{
+		float   u0, v0;
+		float   u1, v1;
+	};
+
+private:
+	std::vector<std::string>    filenames;
+	std::vector<Sprite>         sprites;        // one per file, in the order of filenames
+
+	// every level of the atlas, full size first, filled by the loader and released once uploaded
+	std::vector<unsigned char>  texels;
+	std::vector<size_t>         levelOffsets;
+	int             width;
+	int             height;
+
+	unsigned int    id;
+	size_t          residentBytes;
+
+protected:
+	void        loadData();
+	void        uploadData();
+
+public:
+	// files that cannot be decoded get an empty sprite
+	TextureAtlas(const std::vector<std::string>& filenames);
+	~TextureAtlas();
+
+	unsigned int getSpriteCount() const { return (unsigned int)filenames.size(); }
+	// an empty rectangle until isLoaded()
+	const Sprite& getSprite(unsigned int iSprite) const;
+
+	// binds the atlas for GL_REPLACE texturing, disables texturing until it is ready
+	void        apply();
+	// loads the texture matrix that maps 0..1 texture coordinates onto the sprite, for
+	// geometry such as meshes that carries its own coordinates; both leave GL_MODELVIEW current
+	void        loadSpriteMatrix(unsigned int iSprite);
+	static void resetSpriteMatrix();
+
+	int         getWidth() const { return width; }
+	int         getHeight() const { return height; }
+	// texels of every mip level, as uploaded
+	size_t      getResidentBytes() const { return residentBytes; }
+};
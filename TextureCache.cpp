@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "TextureCache.h"
+#include "TextureMips.h"
+#include "ImageDecoder.h"
+#include "MeshCache.h"
+
+using namespace std;
+
+bool getTextureSourceStamp(const char *filename, uint64_t& size, int64_t& time)
+{
+	// the same stamp the mesh cache uses
+	return getMeshSourceStamp(filename, size, time);
+}
+
+string getTextureCachePath(const char *filename)
+{
+	string path(filename);
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if(dot != string::npos && (slash == string::npos || dot > slash))
+		path.erase(dot);
+	return path + ".dttex";
+}
+
+const TextureCacheHeader* checkTextureCache(const char *data, size_t size, uint64_t sourceSize, int64_t sourceTime)
+{
+	if(data == NULL || size < sizeof(TextureCacheHeader))
+		return NULL;
+
+	const TextureCacheHeader* header = (const TextureCacheHeader*)data;
+	if(memcmp(header->magic, "DTTX", 4) != 0 || header->version != TEXTURE_CACHE_VERSION
+		|| header->sourceSize != sourceSize || header->sourceTime != sourceTime)
+		return NULL;
+	if(header->levelCount == 0 || header->levelCount > 32
+		|| size < sizeof(TextureCacheHeader) + header->levelCount * sizeof(TextureCacheLevel))
+		return NULL;
+
+	const TextureCacheLevel* levels = (const TextureCacheLevel*)(header + 1);
+	for(uint32_t level = 0; level < header->levelCount; level++)
+	{
+		if(levels[level].size != levels[level].width * levels[level].height * header->components
+			|| levels[level].offset > size || levels[level].size > size - levels[level].offset)
+			return NULL;
+	}
+	return header;
+}
+
+void buildTextureCache(const DecodedImage& image, uint64_t sourceSize, int64_t sourceTime, vector<char>& container)
+{
+	uint32_t levelCount = (uint32_t)getMipLevelCount(image.width, image.height);
+
+	// offsets first, so the levels can be filtered straight into the container
+	vector<TextureCacheLevel> levels(levelCount);
+	size_t offset = sizeof(TextureCacheHeader) + levelCount * sizeof(TextureCacheLevel);
+	for(uint32_t level = 0; level < levelCount; level++)
+	{
+		levels[level].width = level == 0 ? image.width : max(1u, levels[level - 1].width / 2);
+		levels[level].height = level == 0 ? image.height : max(1u, levels[level - 1].height / 2);
+		levels[level].size = levels[level].width * levels[level].height * image.components;
+		levels[level].offset = (uint32_t)offset;
+		offset = (offset + levels[level].size + 3) & ~(size_t)3;
+	}
+	container.assign(offset, 0);
+
+	TextureCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "DTTX", 4);
+	header.version = TEXTURE_CACHE_VERSION;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	header.width = image.width;
+	header.height = image.height;
+	header.components = image.components;
+	header.levelCount = levelCount;
+	memcpy(&container[0], &header, sizeof(header));
+	memcpy(&container[sizeof(header)], &levels[0], levelCount * sizeof(TextureCacheLevel));
+
+	memcpy(&container[levels[0].offset], image.pixels, levels[0].size);
+	for(uint32_t level = 1; level < levelCount; level++)
+	{
+		const TextureCacheLevel& source = levels[level - 1];
+		downsampleMip((const unsigned char*)&container[source.offset], source.width, source.height, image.components,
+			(unsigned char*)&container[levels[level].offset]);
+	}
+}
+
+bool saveTextureCache(const char *cachePath, const vector<char>& container)
+{
+	// write next to the final name and swap it in, so a crash never leaves a half written cache behind
+	string tmpPath = string(cachePath) + ".tmp";
+	FILE* file = fopen(tmpPath.c_str(), "wb");
+	if(file == NULL)
+		return false;
+
+	bool ok = container.empty() || fwrite(&container[0], 1, container.size(), file) == container.size();
+	ok = (fclose(file) == 0) && ok;
+
+	remove(cachePath);
+	if(!ok || rename(tmpPath.c_str(), cachePath) != 0)
+	{
+		remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct  DecodedImage;
+
+// Binary layout of a precompiled texture (.dttex), written next to the image it was built from.
+// The header is followed by one TextureCacheLevel per mip level, full size first, then the
+// texels of every level at the recorded offsets (4 byte aligned). Rows are tightly packed,
+// so they are uploaded with GL_UNPACK_ALIGNMENT 1, and the first row is the top of the image.
+// A cache is only used when the size and modification time of the source still match.
+
+#define TEXTURE_CACHE_VERSION 2
+
+struct  TextureCacheHeader
+{
+	char        magic[4];
+	uint32_t    version;
+	uint64_t    sourceSize;
+	int64_t     sourceTime;
+	uint32_t    width;
+	uint32_t    height;
+	uint32_t    components;         // 3 rgb, 4 rgba
+	uint32_t    levelCount;
+};
+
+struct  TextureCacheLevel
+{
+	uint32_t    width;
+	uint32_t    height;
+	uint32_t    offset;             // from the start of the file
+	uint32_t    size;
+};
+
+// Size and modification time of the source file, false if it cannot be found.
+bool        getTextureSourceStamp(const char *filename, uint64_t& size, int64_t& time);
+// "grass.png" -> "grass.dttex"
+std::string getTextureCachePath(const char *filename);
+
+// Header of data when it holds a whole container of the current version built from
+// a source of that size and time, NULL otherwise.
+const TextureCacheHeader* checkTextureCache(const char *data, size_t size, uint64_t sourceSize, int64_t sourceTime);
+
+// Lays out image and its mip chain as a container in memory.
+void    buildTextureCache(const DecodedImage& image, uint64_t sourceSize, int64_t sourceTime, std::vector<char>& container);
+bool    saveTextureCache(const char *cachePath, const std::vector<char>& container);
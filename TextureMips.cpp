@@ -0,0 +1,234 @@
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "TextureMips.h"
+
+// SSE2 is part of every x86-64 target, 32 bit builds only use it when asked to
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_MIPS_SSE2
+#include <emmintrin.h>
+#endif
+
+// Texels are filtered as 4 floats in linear light, whatever the channel count,
+// so every step is one SSE operation per texel.
+#ifdef TEXTURE_MIPS_SSE2
+typedef __m128 Texel;
+static inline Texel loadTexel(const float *p) { return _mm_loadu_ps(p); }
+static inline void storeTexel(float *p, Texel t) { _mm_storeu_ps(p, t); }
+static inline Texel zeroTexel() { return _mm_setzero_ps(); }
+static inline Texel addWeighted(Texel sum, Texel t, float weight) { return _mm_add_ps(sum, _mm_mul_ps(t, _mm_set1_ps(weight))); }
+#else
+struct  Texel { float v[4]; };
+static inline Texel loadTexel(const float *p) { Texel t = { { p[0], p[1], p[2], p[3] } }; return t; }
+static inline void storeTexel(float *p, Texel t) { p[0] = t.v[0]; p[1] = t.v[1]; p[2] = t.v[2]; p[3] = t.v[3]; }
+static inline Texel zeroTexel() { Texel t = { { 0, 0, 0, 0 } }; return t; }
+static inline Texel addWeighted(Texel sum, Texel t, float weight)
+{
+	for(int c = 0; c < 4; c++)
+		sum.v[c] += t.v[c] * weight;
+	return sum;
+}
+#endif
+
+// linear values are encoded through a table indexed by value * (ENCODE_STEPS - 1),
+// fine enough that the result is within half a code of the exact conversion
+enum { ENCODE_STEPS = 4096 };
+
+struct  GammaTables
+{
+	float           toLinear[256];
+	unsigned char   toSrgb[ENCODE_STEPS];
+
+	GammaTables()
+	{
+		for(int i = 0; i < 256; i++)
+		{
+			float value = i / 255.0f;
+			toLinear[i] = value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+		}
+		for(int i = 0; i < ENCODE_STEPS; i++)
+		{
+			float value = i / (float)(ENCODE_STEPS - 1);
+			float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+			toSrgb[i] = (unsigned char)(srgb * 255.0f + 0.5f);
+		}
+	}
+};
+
+static const GammaTables& getGammaTables()
+{
+	static const GammaTables tables;
+	return tables;
+}
+
+// source texels and weights behind one target texel along one axis
+struct  Taps
+{
+	int     first;
+	int     count;
+	float   weight[3];
+};
+
+static void computeTaps(int size, std::vector<Taps>& taps)
+{
+	int mipSize = std::max(1, size / 2);
+	taps.resize(mipSize);
+	for(int i = 0; i < mipSize; i++)
+	{
+		Taps& tap = taps[i];
+		if(size == 1)
+		{
+			tap.first = 0;
+			tap.count = 1;
+			tap.weight[0] = 1.0f;
+		}
+		else if(size % 2 == 0)
+		{
+			tap.first = i * 2;
+			tap.count = 2;
+			tap.weight[0] = tap.weight[1] = 0.5f;
+		}
+		else
+		{
+			// size 2n+1 onto n texels: texel i covers [i, i+1) * (2n+1)/n
+			int n = mipSize;
+			tap.first = i * 2;
+			tap.count = 3;
+			tap.weight[0] = (float)(n - i) / size;
+			tap.weight[1] = (float)n / size;
+			tap.weight[2] = (float)(i + 1) / size;
+		}
+	}
+}
+
+// the last channel of grey alpha and rgba images is alpha, everything else is a color
+template<int components>
+struct  ChannelLayout
+{
+	enum { COLORS = components == 2 || components == 4 ? components - 1 : components };
+};
+
+template<int components>
+static void linearizeRow(const GammaTables& tables, const unsigned char *source, int width, float *row)
+{
+	const int colors = ChannelLayout<components>::COLORS;
+	for(int x = 0; x < width; x++, source += components, row += 4)
+	{
+		for(int c = 0; c < colors; c++)
+			row[c] = tables.toLinear[source[c]];
+		for(int c = colors; c < 4; c++)
+			row[c] = c < components ? source[c] * (1.0f / 255.0f) : 0.0f;
+	}
+}
+
+template<int components>
+static inline void encodeTexel(const GammaTables& tables, Texel texel, unsigned char *destination)
+{
+	const int colors = ChannelLayout<components>::COLORS;
+	const float colorScale = ENCODE_STEPS - 1;
+	int codes[4];
+#ifdef TEXTURE_MIPS_SSE2
+	// clamped and scaled to table indices for colors, to 0..255 for alpha, rounded to nearest
+	__m128 scale = _mm_setr_ps(colorScale, colors > 1 ? colorScale : 255.0f, colors > 2 ? colorScale : 255.0f, 255.0f);
+	texel = _mm_min_ps(_mm_max_ps(texel, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	_mm_storeu_si128((__m128i*)codes, _mm_cvtps_epi32(_mm_mul_ps(texel, scale)));
+#else
+	for(int c = 0; c < components; c++)
+		codes[c] = (int)(std::min(std::max(texel.v[c], 0.0f), 1.0f) * (c < colors ? colorScale : 255.0f) + 0.5f);
+#endif
+	for(int c = 0; c < colors; c++)
+		destination[c] = tables.toSrgb[codes[c]];
+	for(int c = colors; c < components; c++)
+		destination[c] = (unsigned char)codes[c];
+}
+
+// filters target rows [firstRow, lastRow)
+template<int components>
+static void downsampleRows(const unsigned char *source, int width, unsigned char *destination,
+	const std::vector<Taps>* columnTaps, const std::vector<Taps>* rowTaps, int firstRow, int lastRow)
+{
+	const GammaTables& tables = getGammaTables();
+	int mipWidth = (int)columnTaps->size();
+	std::vector<float> rows(3 * width * 4);
+	std::vector<float> column(width * 4);
+	bool evenWidth = width % 2 == 0;
+
+	for(int y = firstRow; y < lastRow; y++)
+	{
+		const Taps& rowTap = (*rowTaps)[y];
+		for(int k = 0; k < rowTap.count; k++)
+			linearizeRow<components>(tables, source + (size_t)(rowTap.first + k) * width * components, width, &rows[k * width * 4]);
+
+		unsigned char* target = destination + (size_t)y * mipWidth * components;
+		if(evenWidth && rowTap.count == 2)
+		{
+			// the common 2x2 box, in one pass
+			const float* row0 = &rows[0];
+			const float* row1 = &rows[width * 4];
+			for(int x = 0; x < mipWidth; x++, row0 += 8, row1 += 8, target += components)
+			{
+				Texel sum = addWeighted(zeroTexel(), loadTexel(row0), 0.25f);
+				sum = addWeighted(sum, loadTexel(row0 + 4), 0.25f);
+				sum = addWeighted(sum, loadTexel(row1), 0.25f);
+				sum = addWeighted(sum, loadTexel(row1 + 4), 0.25f);
+				encodeTexel<components>(tables, sum, target);
+			}
+			continue;
+		}
+
+		// vertical pass into one row of sums, then the horizontal pass over it
+		for(int x = 0; x < width; x++)
+		{
+			Texel sum = zeroTexel();
+			for(int k = 0; k < rowTap.count; k++)
+				sum = addWeighted(sum, loadTexel(&rows[(k * width + x) * 4]), rowTap.weight[k]);
+			storeTexel(&column[x * 4], sum);
+		}
+		for(int x = 0; x < mipWidth; x++, target += components)
+		{
+			const Taps& columnTap = (*columnTaps)[x];
+			Texel sum = zeroTexel();
+			for(int k = 0; k < columnTap.count; k++)
+				sum = addWeighted(sum, loadTexel(&column[(columnTap.first + k) * 4]), columnTap.weight[k]);
+			encodeTexel<components>(tables, sum, target);
+		}
+	}
+}
+
+typedef void (*DownsampleRows)(const unsigned char*, int, unsigned char*, const std::vector<Taps>*, const std::vector<Taps>*, int, int);
+
+int getMipLevelCount(int width, int height)
+{
+	int levels = 1;
+	for(int size = std::max(width, height); size > 1; size /= 2)
+		levels++;
+	return levels;
+}
+
+void downsampleMip(const unsigned char *source, int width, int height, int components, unsigned char *destination, unsigned int threads)
+{
+	std::vector<Taps> columnTaps, rowTaps;
+	computeTaps(width, columnTaps);
+	computeTaps(height, rowTaps);
+	int mipWidth = (int)columnTaps.size();
+	int mipHeight = (int)rowTaps.size();
+
+	// bands of at least minBandTexels target texels, smaller levels are not worth a thread
+	const int minBandTexels = 64 * 1024;
+	unsigned int nThreads = threads != 0 ? threads : std::thread::hardware_concurrency();
+	int nBands = (int)std::max<size_t>(1, std::min<size_t>(std::max(nThreads, 1u), (size_t)mipWidth * mipHeight / minBandTexels));
+	nBands = std::min(nBands, mipHeight);
+
+	static const DownsampleRows byComponents[] = { downsampleRows<1>, downsampleRows<2>, downsampleRows<3>, downsampleRows<4> };
+	DownsampleRows filter = byComponents[components - 1];
+
+	std::vector<std::thread> workers;
+	for(int i = 1; i < nBands; i++)
+		workers.push_back(std::thread(filter, source, width, destination,
+			&columnTaps, &rowTaps, mipHeight * i / nBands, mipHeight * (i + 1) / nBands));
+	filter(source, width, destination, &columnTaps, &rowTaps, 0, mipHeight / nBands);
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
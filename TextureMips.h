@@ -0,0 +1,14 @@
+#pragma once
+
+// Mip chain generation for 8 bit per channel images with tightly packed rows.
+// Color channels are sRGB encoded, so they are averaged in linear light and encoded
+// again; alpha (the last channel of 2 and 4 channel images) is averaged as stored.
+
+// levels down to 1x1, each halving the size (rounded down, at least 1) like GL does
+int     getMipLevelCount(int width, int height);
+
+// Box filters source into the next level, max(1, width / 2) x max(1, height / 2) texels.
+// An odd side is not rescaled first: every target texel covers its exact share of the
+// source, so three source texels contribute with weights that add up to one.
+// Large images are split into bands of rows filtered on threads threads, 0 picks one per core.
+void    downsampleMip(const unsigned char *source, int width, int height, int components, unsigned char *destination, unsigned int threads = 0);
@@ -0,0 +1,191 @@
+#include <deque>
+#include <mutex>
+
+#include "TextureUploads.h"
+#include "GLExtensions.h"
+
+enum { RESERVED, FENCED, DONE };
+
+struct  Region
+{
+	uint64_t    id;
+	size_t      offset;
+	size_t      size;
+	int         state;
+	GLsync      fence;
+};
+
+// the ring is shared with the loader threads and guarded by one mutex
+static std::mutex           ringMutex;
+static std::deque<Region>   regions;        // oldest first, consecutive ids
+static uint64_t             nextId = 1;
+static GLuint               ringBuffer = 0;
+static char*                ringData = NULL;
+static size_t               ringSize = 0;
+
+// regions start on multiples of this, enough for any texel alignment
+static const size_t regionAlignment = 256;
+
+bool TextureUploads::start(size_t bytes)
+{
+	if(ringData != NULL || !GLExtensions::persistentPixelBuffers)
+		return ringData != NULL;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLExtensions::genBuffers(1, &ringBuffer);
+	GLExtensions::bindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+	GLExtensions::bufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, flags);
+	char* data = (char*)GLExtensions::mapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags);
+	GLExtensions::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if(data == NULL)
+	{
+		GLExtensions::deleteBuffers(1, &ringBuffer);
+		ringBuffer = 0;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(ringMutex);
+	ringData = data;
+	ringSize = bytes;
+	return true;
+}
+
+void TextureUploads::stop()
+{
+	std::lock_guard<std::mutex> lock(ringMutex);
+	for(size_t i = 0; i < regions.size(); i++)
+	{
+		if(regions[i].state == FENCED)
+			GLExtensions::deleteSync(regions[i].fence);
+	}
+	regions.clear();
+	// deleting the buffer unmaps it
+	if(ringBuffer != 0)
+		GLExtensions::deleteBuffers(1, &ringBuffer);
+	ringBuffer = 0;
+	ringData = NULL;
+	ringSize = 0;
+}
+
+bool TextureUploads::isStarted()
+{
+	std::lock_guard<std::mutex> lock(ringMutex);
+	return ringData != NULL;
+}
+
+// where size bytes fit after the newest region without reaching the oldest one
+static bool findSpace(size_t size, size_t& offset)
+{
+	if(regions.empty())
+	{
+		offset = 0;
+		return size <= ringSize;
+	}
+	size_t head = regions.front().offset;
+	size_t tail = regions.back().offset + regions.back().size;
+	if(regions.back().offset >= head)
+	{
+		// the live regions are one run, there is room after it and before it
+		if(tail + size <= ringSize)
+			offset = tail;
+		else if(size <= head)
+			offset = 0;
+		else
+			return false;
+		return true;
+	}
+	// wrapped around, the room is between the newest and the oldest region
+	offset = tail;
+	return tail + size <= head;
+}
+
+static Region* findRegion(uint64_t id)
+{
+	if(regions.empty() || id < regions.front().id)
+		return NULL;
+	size_t index = (size_t)(id - regions.front().id);
+	return index < regions.size() ? &regions[index] : NULL;
+}
+
+// true once the region is free to be written again
+static bool pollFence(Region& region)
+{
+	if(region.state == FENCED)
+	{
+		// a failed wait counts as done, nothing else would ever release the region
+		GLenum result = GLExtensions::clientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if(result != GL_TIMEOUT_EXPIRED)
+		{
+			GLExtensions::deleteSync(region.fence);
+			region.fence = 0;
+			region.state = DONE;
+		}
+	}
+	return region.state == DONE;
+}
+
+char* TextureUploads::reserve(size_t size, StagedUpload& upload)
+{
+	std::lock_guard<std::mutex> lock(ringMutex);
+	size_t alignedSize = (size + regionAlignment - 1) & ~(regionAlignment - 1);
+	size_t offset;
+	if(ringData == NULL || size == 0 || !findSpace(alignedSize, offset))
+		return NULL;
+
+	Region region = { nextId++, offset, alignedSize, RESERVED, 0 };
+	regions.push_back(region);
+	upload.id = region.id;
+	upload.offset = offset;
+	upload.size = size;
+	return ringData + offset;
+}
+
+void TextureUploads::discard(StagedUpload& upload)
+{
+	if(upload.id == 0)
+		return;
+	std::lock_guard<std::mutex> lock(ringMutex);
+	Region* region = findRegion(upload.id);
+	if(region != NULL && region->state == RESERVED)
+		region->state = DONE;
+	upload = StagedUpload();
+}
+
+const char* TextureUploads::beginUpload(const StagedUpload& upload)
+{
+	GLExtensions::bindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+	// with an unpack buffer bound, pointers are offsets into it
+	return (const char*)(uintptr_t)upload.offset;
+}
+
+void TextureUploads::endUpload(StagedUpload& upload)
+{
+	GLExtensions::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	GLsync fence = GLExtensions::fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	std::lock_guard<std::mutex> lock(ringMutex);
+	Region* region = findRegion(upload.id);
+	if(region != NULL)
+	{
+		region->fence = fence;
+		region->state = FENCED;
+	}
+	else
+		GLExtensions::deleteSync(fence);
+}
+
+bool TextureUploads::isComplete(const StagedUpload& upload)
+{
+	if(upload.id == 0)
+		return true;
+	std::lock_guard<std::mutex> lock(ringMutex);
+	Region* region = findRegion(upload.id);
+	return region == NULL || pollFence(*region);
+}
+
+void TextureUploads::retire()
+{
+	std::lock_guard<std::mutex> lock(ringMutex);
+	while(!regions.empty() && pollFence(regions.front()))
+		regions.pop_front();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// A region of the staging ring reserved for one texture.
+struct  StagedUpload
+{
+	uint64_t    id;         // 0 when nothing is staged
+	size_t      offset;     // in the ring buffer
+	size_t      size;
+
+	StagedUpload() : id(0), offset(0), size(0) {}
+};
+
+// Staging ring for texture uploads: one pixel unpack buffer that stays mapped for the
+// life of the program. Loader threads copy texels into a region of it, the render thread
+// only issues the glTexImage2D calls reading from the buffer, so the copy out of it is
+// done by the driver without stalling the frame, and puts a fence behind them.
+// Regions come back once their fence is signalled, oldest first.
+// Everything but reserve() runs on the thread that owns the context.
+class   TextureUploads
+{
+public:
+	// needs GLExtensions::persistentPixelBuffers, false leaves staging off
+	static bool start(size_t bytes);
+	static bool isStarted();
+	// deletes the ring and its fences while the context is still there; staging is off
+	// afterwards and uploads that were staged count as complete
+	static void stop();
+
+	// loader threads: a region of size bytes to write the texels to, NULL when staging
+	// is off or the ring is full, then the texels have to be uploaded from client memory
+	static char* reserve(size_t size, StagedUpload& upload);
+	// for an upload that will never be issued
+	static void discard(StagedUpload& upload);
+
+	// binds the ring as the unpack buffer and returns the pointer that addresses the
+	// first byte of the upload's region in glTexImage2D and the like
+	static const char* beginUpload(const StagedUpload& upload);
+	// unbinds the ring and fences the upload
+	static void endUpload(StagedUpload& upload);
+	// true once GL is done reading the upload, and for uploads that were never staged
+	static bool isComplete(const StagedUpload& upload);
+
+	// hands back the regions of finished uploads, call once a frame
+	static void retire();
+};
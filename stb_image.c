@@ -20,6 +20,7 @@ PIC (Softimage PIC)
 - decode from memory or through FILE (define STBI_NO_STDIO to remove code)
 - decode from arbitrary I/O callbacks
 - overridable dequantizing-IDCT, YCbCr-to-RGB conversion (define STBI_SIMD)
+- SSE2 (runtime checked) and NEON (define STBI_NEON) JPEG IDCT, upsampling and color conversion
 
 Latest revisions:
 1.33 (2011-07-14) minor fixes suggested by Dave Moore
@@ -266,7 +267,7 @@ extern "C" {
 
 
 	// get a VERY brief reason for failure
-	// NOT THREADSAFE
+	// reports the last failure on the calling thread
 	extern const char *stbi_failure_reason(void);
 
 	// free the loaded image -- this is just free()
@@ -293,6 +294,23 @@ extern "C" {
 	// or just pass them through "as-is"
 	extern void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 
+	// the same two settings for decodes on the calling thread only, where
+	// STBI_THREAD_LOCAL is available; without it they set them for every thread
+	extern void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply);
+	extern void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
+
+	// JPEG decodes use SSE2 or NEON kernels for the IDCT, upsampling and color
+	// conversion where the CPU has them. pass 0 to use the scalar code instead,
+	// e.g. to compare the two; affects decodes started afterwards on all threads
+	extern void stbi_set_jpeg_simd(int flag_true_if_should_use_simd);
+	// whether SIMD kernels were compiled in and the CPU supports them
+	extern int  stbi_jpeg_simd_available(void);
+
+	// zlib streams (all of PNG) inflate through multi-symbol lookup tables and a
+	// 64 bit bit buffer. pass 0 to use the original bit-by-bit decoder instead;
+	// affects decodes started afterwards on all threads
+	extern void stbi_set_fast_inflate(int flag_true_if_should_use_fast_inflate);
+
 
 	// ZLIB client - used by PNG, available for other purposes
 
@@ -348,6 +366,36 @@ extern "C" {
 #include <assert.h>
 #include <stdarg.h>
 
+// per thread storage for the state a decode writes, so images can be decoded on several threads at once
+#ifndef STBI_THREAD_LOCAL
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define STBI_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define STBI_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define STBI_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define STBI_THREAD_LOCAL _Thread_local
+#endif
+#endif
+
+// SIMD kernels for the JPEG decoder. SSE2 is used wherever the compiler can target it
+// and the CPU reports it at runtime; NEON only when the build defines STBI_NEON.
+// STBI_NO_SIMD, or installing your own kernels with STBI_SIMD, keeps the scalar code
+#if defined(STBI_NO_SIMD) || defined(STBI_SIMD)
+#undef STBI_NEON
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#define STBI_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h> // __cpuid
+#endif
+#endif
+
+#ifdef STBI_NEON
+#include <arm_neon.h>
+#endif
+
 #ifndef _MSC_VER
 #ifdef __cplusplus
 #define stbi_inline inline
@@ -366,6 +414,7 @@ typedef   signed short  int16;
 typedef unsigned int   uint32;
 typedef   signed int    int32;
 typedef unsigned int   uint;
+typedef unsigned long long uint64;
 
 // should produce compiler error if size is wrong
 typedef unsigned char validate_uint32[sizeof(uint32) == 4 ? 1 : -1];
@@ -494,8 +543,12 @@ static stbi_uc *stbi_gif_load(stbi *s, int *x, int *y, int *comp, int req_comp);
 static int      stbi_gif_info(stbi *s, int *x, int *y, int *comp);
 
 
-// this is not threadsafe
+// one per thread where STBI_THREAD_LOCAL is available, shared otherwise
+#ifdef STBI_THREAD_LOCAL
+static STBI_THREAD_LOCAL const char *failure_reason;
+#else
 static const char *failure_reason;
+#endif
 
 const char *stbi_failure_reason(void)
 {
@@ -1002,6 +1055,13 @@ typedef struct
 
 	int scan_n, order[4];
 	int restart_interval, todo;
+
+#ifndef STBI_SIMD
+	// scalar or SIMD versions, picked by setup_jpeg_kernels
+	void(*idct_block_kernel)(uint8 *out, int out_stride, short data[64], uint8 *dequantize);
+	void(*YCbCr_to_RGB_kernel)(uint8 *out, const uint8 *y, const uint8 *pcb, const uint8 *pcr, int count, int step);
+	uint8 *(*resample_row_hv_2_kernel)(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs);
+#endif
 } jpeg;
 
 static int build_huffman(huffman *h, int *count)
@@ -1325,6 +1385,407 @@ void stbi_install_idct(stbi_idct_8x8 func)
 }
 #endif
 
+#ifdef STBI_SSE2
+// SSE2 integer IDCT, ported from stb_image 2.x. it produces bit-identical results to
+// idct_block; the dequantizing multiply is done in 16 bits when loading the rows
+static void idct_block_simd(uint8 *out, int out_stride, short data[64], uint8 *dequantize)
+{
+	// This is constructed to match our regular (generic) integer IDCT exactly.
+	__m128i row0, row1, row2, row3, row4, row5, row6, row7;
+	__m128i tmp;
+
+	// dot product constant: even elems=x, odd elems=y
+#define dct_const(x,y)  _mm_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y))
+
+	// out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+	// out(1) = c1[even]*x + c1[odd]*y
+#define dct_rot(out0,out1, x,y,c0,c1) \
+      __m128i c0##lo = _mm_unpacklo_epi16((x),(y)); \
+      __m128i c0##hi = _mm_unpackhi_epi16((x),(y)); \
+      __m128i out0##_l = _mm_madd_epi16(c0##lo, c0); \
+      __m128i out0##_h = _mm_madd_epi16(c0##hi, c0); \
+      __m128i out1##_l = _mm_madd_epi16(c0##lo, c1); \
+      __m128i out1##_h = _mm_madd_epi16(c0##hi, c1)
+
+	// out = in << 12  (in 16-bit, out 32-bit)
+#define dct_widen(out, in) \
+      __m128i out##_l = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), (in)), 4); \
+      __m128i out##_h = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), (in)), 4)
+
+	// wide add
+#define dct_wadd(out, a, b) \
+      __m128i out##_l = _mm_add_epi32(a##_l, b##_l); \
+      __m128i out##_h = _mm_add_epi32(a##_h, b##_h)
+
+	// wide sub
+#define dct_wsub(out, a, b) \
+      __m128i out##_l = _mm_sub_epi32(a##_l, b##_l); \
+      __m128i out##_h = _mm_sub_epi32(a##_h, b##_h)
+
+	// one row of coefficients times its row of the quantization table
+#define dct_load(row, k) \
+      row = _mm_mullo_epi16(_mm_loadu_si128((const __m128i *) (data + (k) * 8)), \
+         _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (dequantize + (k) * 8)), _mm_setzero_si128()))
+
+	// butterfly a/b, add bias, then shift by "s" and pack
+#define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m128i abiased_l = _mm_add_epi32(a##_l, bias); \
+         __m128i abiased_h = _mm_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm_packs_epi32(_mm_srai_epi32(sum_l, s), _mm_srai_epi32(sum_h, s)); \
+         out1 = _mm_packs_epi32(_mm_srai_epi32(dif_l, s), _mm_srai_epi32(dif_h, s)); \
+      }
+
+	// 8-bit interleave step (for transposes)
+#define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+	// 16-bit interleave step (for transposes)
+#define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+#define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+	__m128i rot0_0 = dct_const(f2f(0.5411961f), f2f(0.5411961f) + f2f(-1.847759065f));
+	__m128i rot0_1 = dct_const(f2f(0.5411961f) + f2f(0.765366865f), f2f(0.5411961f));
+	__m128i rot1_0 = dct_const(f2f(1.175875602f) + f2f(-0.899976223f), f2f(1.175875602f));
+	__m128i rot1_1 = dct_const(f2f(1.175875602f), f2f(1.175875602f) + f2f(-2.562915447f));
+	__m128i rot2_0 = dct_const(f2f(-1.961570560f) + f2f(0.298631336f), f2f(-1.961570560f));
+	__m128i rot2_1 = dct_const(f2f(-1.961570560f), f2f(-1.961570560f) + f2f(3.072711026f));
+	__m128i rot3_0 = dct_const(f2f(-0.390180644f) + f2f(2.053119869f), f2f(-0.390180644f));
+	__m128i rot3_1 = dct_const(f2f(-0.390180644f), f2f(-0.390180644f) + f2f(1.501321110f));
+
+	// rounding biases in column/row passes, see idct_block for explanation.
+	__m128i bias_0 = _mm_set1_epi32(512);
+	__m128i bias_1 = _mm_set1_epi32(65536 + (128 << 17));
+
+	// load and dequantize, the products fit 16 bits for any valid stream
+	dct_load(row0, 0);
+	dct_load(row1, 1);
+	dct_load(row2, 2);
+	dct_load(row3, 3);
+	dct_load(row4, 4);
+	dct_load(row5, 5);
+	dct_load(row6, 6);
+	dct_load(row7, 7);
+
+	// column pass
+	dct_pass(bias_0, 10);
+
+	{
+		// 16bit 8x8 transpose pass 1
+		dct_interleave16(row0, row4);
+		dct_interleave16(row1, row5);
+		dct_interleave16(row2, row6);
+		dct_interleave16(row3, row7);
+
+
+		// transpose pass 2
+		dct_interleave16(row0, row2);
+		dct_interleave16(row1, row3);
+		dct_interleave16(row4, row6);
+		dct_interleave16(row5, row7);
+
+
+		// transpose pass 3
+		dct_interleave16(row0, row1);
+		dct_interleave16(row2, row3);
+		dct_interleave16(row4, row5);
+		dct_interleave16(row6, row7);
+	}
+
+	// row pass
+	dct_pass(bias_1, 17);
+
+	{
+		// pack
+		__m128i p0 = _mm_packus_epi16(row0, row1); // a0a1a2a3...a7b0b1b2b3...b7
+		__m128i p1 = _mm_packus_epi16(row2, row3);
+		__m128i p2 = _mm_packus_epi16(row4, row5);
+		__m128i p3 = _mm_packus_epi16(row6, row7);
+
+		// 8bit 8x8 transpose pass 1
+		dct_interleave8(p0, p2); // a0e0a1e1...
+		dct_interleave8(p1, p3); // c0g0c1g1...
+
+		// transpose pass 2
+		dct_interleave8(p0, p1); // a0c0e0g0...
+		dct_interleave8(p2, p3); // b0d0f0h0...
+
+		// transpose pass 3
+		dct_interleave8(p0, p2); // a0b0c0d0...
+		dct_interleave8(p1, p3); // a4b4c4d4...
+
+		// store
+		_mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+		_mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+		_mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+		_mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+		_mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+		_mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+		_mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+		_mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+	}
+
+#undef dct_const
+#undef dct_load
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+
+#endif // STBI_SSE2
+
+#ifdef STBI_NEON
+// NEON integer IDCT, ported from stb_image 2.x. should produce bit-identical
+// results to idct_block.
+static void idct_block_simd(uint8 *out, int out_stride, short data[64], uint8 *dequantize)
+{
+	int16x8_t row0, row1, row2, row3, row4, row5, row6, row7;
+
+	int16x4_t rot0_0 = vdup_n_s16(f2f(0.5411961f));
+	int16x4_t rot0_1 = vdup_n_s16(f2f(-1.847759065f));
+	int16x4_t rot0_2 = vdup_n_s16(f2f(0.765366865f));
+	int16x4_t rot1_0 = vdup_n_s16(f2f(1.175875602f));
+	int16x4_t rot1_1 = vdup_n_s16(f2f(-0.899976223f));
+	int16x4_t rot1_2 = vdup_n_s16(f2f(-2.562915447f));
+	int16x4_t rot2_0 = vdup_n_s16(f2f(-1.961570560f));
+	int16x4_t rot2_1 = vdup_n_s16(f2f(-0.390180644f));
+	int16x4_t rot3_0 = vdup_n_s16(f2f(0.298631336f));
+	int16x4_t rot3_1 = vdup_n_s16(f2f(2.053119869f));
+	int16x4_t rot3_2 = vdup_n_s16(f2f(3.072711026f));
+	int16x4_t rot3_3 = vdup_n_s16(f2f(1.501321110f));
+
+#define dct_long_mul(out, inq, coeff) \
+   int32x4_t out##_l = vmull_s16(vget_low_s16(inq), coeff); \
+   int32x4_t out##_h = vmull_s16(vget_high_s16(inq), coeff)
+
+#define dct_long_mac(out, acc, inq, coeff) \
+   int32x4_t out##_l = vmlal_s16(acc##_l, vget_low_s16(inq), coeff); \
+   int32x4_t out##_h = vmlal_s16(acc##_h, vget_high_s16(inq), coeff)
+
+#define dct_widen(out, inq) \
+   int32x4_t out##_l = vshll_n_s16(vget_low_s16(inq), 12); \
+   int32x4_t out##_h = vshll_n_s16(vget_high_s16(inq), 12)
+
+	// wide add
+#define dct_wadd(out, a, b) \
+   int32x4_t out##_l = vaddq_s32(a##_l, b##_l); \
+   int32x4_t out##_h = vaddq_s32(a##_h, b##_h)
+
+	// wide sub
+#define dct_wsub(out, a, b) \
+   int32x4_t out##_l = vsubq_s32(a##_l, b##_l); \
+   int32x4_t out##_h = vsubq_s32(a##_h, b##_h)
+
+	// one row of coefficients times its row of the quantization table
+#define dct_load(row, k) \
+   row = vmulq_s16(vld1q_s16(data + (k) * 8), vreinterpretq_s16_u16(vmovl_u8(vld1_u8(dequantize + (k) * 8))))
+
+	// butterfly a/b, then shift using "shiftop" by "s" and pack
+#define dct_bfly32o(out0,out1, a,b,shiftop,s) \
+   { \
+      dct_wadd(sum, a, b); \
+      dct_wsub(dif, a, b); \
+      out0 = vcombine_s16(shiftop(sum_l, s), shiftop(sum_h, s)); \
+      out1 = vcombine_s16(shiftop(dif_l, s), shiftop(dif_h, s)); \
+   }
+
+#define dct_pass(shiftop, shift) \
+   { \
+      /* even part */ \
+      int16x8_t sum26 = vaddq_s16(row2, row6); \
+      dct_long_mul(p1e, sum26, rot0_0); \
+      dct_long_mac(t2e, p1e, row6, rot0_1); \
+      dct_long_mac(t3e, p1e, row2, rot0_2); \
+      int16x8_t sum04 = vaddq_s16(row0, row4); \
+      int16x8_t dif04 = vsubq_s16(row0, row4); \
+      dct_widen(t0e, sum04); \
+      dct_widen(t1e, dif04); \
+      dct_wadd(x0, t0e, t3e); \
+      dct_wsub(x3, t0e, t3e); \
+      dct_wadd(x1, t1e, t2e); \
+      dct_wsub(x2, t1e, t2e); \
+      /* odd part */ \
+      int16x8_t sum15 = vaddq_s16(row1, row5); \
+      int16x8_t sum17 = vaddq_s16(row1, row7); \
+      int16x8_t sum35 = vaddq_s16(row3, row5); \
+      int16x8_t sum37 = vaddq_s16(row3, row7); \
+      int16x8_t sumodd = vaddq_s16(sum17, sum35); \
+      dct_long_mul(p5o, sumodd, rot1_0); \
+      dct_long_mac(p1o, p5o, sum17, rot1_1); \
+      dct_long_mac(p2o, p5o, sum35, rot1_2); \
+      dct_long_mul(p3o, sum37, rot2_0); \
+      dct_long_mul(p4o, sum15, rot2_1); \
+      dct_wadd(sump13o, p1o, p3o); \
+      dct_wadd(sump24o, p2o, p4o); \
+      dct_wadd(sump23o, p2o, p3o); \
+      dct_wadd(sump14o, p1o, p4o); \
+      dct_long_mac(x4, sump13o, row7, rot3_0); \
+      dct_long_mac(x5, sump24o, row5, rot3_1); \
+      dct_long_mac(x6, sump23o, row3, rot3_2); \
+      dct_long_mac(x7, sump14o, row1, rot3_3); \
+      dct_bfly32o(row0,row7, x0,x7,shiftop,shift); \
+      dct_bfly32o(row1,row6, x1,x6,shiftop,shift); \
+      dct_bfly32o(row2,row5, x2,x5,shiftop,shift); \
+      dct_bfly32o(row3,row4, x3,x4,shiftop,shift); \
+   }
+
+	// load and dequantize, the products fit 16 bits for any valid stream
+	dct_load(row0, 0);
+	dct_load(row1, 1);
+	dct_load(row2, 2);
+	dct_load(row3, 3);
+	dct_load(row4, 4);
+	dct_load(row5, 5);
+	dct_load(row6, 6);
+	dct_load(row7, 7);
+
+	// add DC bias
+	row0 = vaddq_s16(row0, vsetq_lane_s16(1024, vdupq_n_s16(0), 0));
+
+	// column pass
+	dct_pass(vrshrn_n_s32, 10);
+
+	// 16bit 8x8 transpose
+	{
+		// these three map to a single VTRN.16, VTRN.32, and VSWP, respectively.
+		// whether compilers actually get this is another story, sadly.
+#define dct_trn16(x, y) { int16x8x2_t t = vtrnq_s16(x, y); x = t.val[0]; y = t.val[1]; }
+#define dct_trn32(x, y) { int32x4x2_t t = vtrnq_s32(vreinterpretq_s32_s16(x), vreinterpretq_s32_s16(y)); x = vreinterpretq_s16_s32(t.val[0]); y = vreinterpretq_s16_s32(t.val[1]); }
+#define dct_trn64(x, y) { int16x8_t x0 = x; int16x8_t y0 = y; x = vcombine_s16(vget_low_s16(x0), vget_low_s16(y0)); y = vcombine_s16(vget_high_s16(x0), vget_high_s16(y0)); }
+
+		// pass 1
+		dct_trn16(row0, row1); // a0b0a2b2a4b4a6b6
+		dct_trn16(row2, row3);
+		dct_trn16(row4, row5);
+		dct_trn16(row6, row7);
+
+		// pass 2
+		dct_trn32(row0, row2); // a0b0c0d0a4b4c4d4
+		dct_trn32(row1, row3);
+		dct_trn32(row4, row6);
+		dct_trn32(row5, row7);
+
+		// pass 3
+		dct_trn64(row0, row4); // a0b0c0d0e0f0g0h0
+		dct_trn64(row1, row5);
+		dct_trn64(row2, row6);
+		dct_trn64(row3, row7);
+
+#undef dct_trn16
+#undef dct_trn32
+#undef dct_trn64
+	}
+
+	// row pass
+	// vrshrn_n_s32 only supports shifts up to 16, we need
+	// 17. so do a non-rounding shift of 16 first then follow
+	// up with a rounding shift by 1.
+	dct_pass(vshrn_n_s32, 16);
+
+	{
+		// pack and round
+		uint8x8_t p0 = vqrshrun_n_s16(row0, 1);
+		uint8x8_t p1 = vqrshrun_n_s16(row1, 1);
+		uint8x8_t p2 = vqrshrun_n_s16(row2, 1);
+		uint8x8_t p3 = vqrshrun_n_s16(row3, 1);
+		uint8x8_t p4 = vqrshrun_n_s16(row4, 1);
+		uint8x8_t p5 = vqrshrun_n_s16(row5, 1);
+		uint8x8_t p6 = vqrshrun_n_s16(row6, 1);
+		uint8x8_t p7 = vqrshrun_n_s16(row7, 1);
+
+		// again, these can translate into one instruction, but often don't.
+#define dct_trn8_8(x, y) { uint8x8x2_t t = vtrn_u8(x, y); x = t.val[0]; y = t.val[1]; }
+#define dct_trn8_16(x, y) { uint16x4x2_t t = vtrn_u16(vreinterpret_u16_u8(x), vreinterpret_u16_u8(y)); x = vreinterpret_u8_u16(t.val[0]); y = vreinterpret_u8_u16(t.val[1]); }
+#define dct_trn8_32(x, y) { uint32x2x2_t t = vtrn_u32(vreinterpret_u32_u8(x), vreinterpret_u32_u8(y)); x = vreinterpret_u8_u32(t.val[0]); y = vreinterpret_u8_u32(t.val[1]); }
+
+		// sadly can't use interleaved stores here since we only write
+		// 8 bytes to each scan line!
+
+		// 8x8 8-bit transpose pass 1
+		dct_trn8_8(p0, p1);
+		dct_trn8_8(p2, p3);
+		dct_trn8_8(p4, p5);
+		dct_trn8_8(p6, p7);
+
+		// pass 2
+		dct_trn8_16(p0, p2);
+		dct_trn8_16(p1, p3);
+		dct_trn8_16(p4, p6);
+		dct_trn8_16(p5, p7);
+
+		// pass 3
+		dct_trn8_32(p0, p4);
+		dct_trn8_32(p1, p5);
+		dct_trn8_32(p2, p6);
+		dct_trn8_32(p3, p7);
+
+
+		// store
+		vst1_u8(out, p0); out += out_stride;
+		vst1_u8(out, p1); out += out_stride;
+		vst1_u8(out, p2); out += out_stride;
+		vst1_u8(out, p3); out += out_stride;
+		vst1_u8(out, p4); out += out_stride;
+		vst1_u8(out, p5); out += out_stride;
+		vst1_u8(out, p6); out += out_stride;
+		vst1_u8(out, p7);
+
+#undef dct_trn8_8
+#undef dct_trn8_16
+#undef dct_trn8_32
+	}
+
+#undef dct_load
+#undef dct_long_mul
+#undef dct_long_mac
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_pass
+}
+
+#endif // STBI_NEON
+
 #define MARKER_none  0xff
 // if there's a pending marker from the entropy stream, return that
 // otherwise, fetch from the stream and get a marker. if there's no
@@ -1380,7 +1841,7 @@ static int parse_entropy_coded_data(jpeg *z)
 #ifdef STBI_SIMD
 				stbi_idct_installed(z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
 #else
-				idct_block(z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
+				z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
 #endif
 				// every data block is an MCU, so countdown the restart interval
 				if (--z->todo <= 0) {
@@ -1411,7 +1872,7 @@ static int parse_entropy_coded_data(jpeg *z)
 #ifdef STBI_SIMD
 							stbi_idct_installed(z->img_comp[n].data + z->img_comp[n].w2*y2 + x2, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
 #else
-							idct_block(z->img_comp[n].data + z->img_comp[n].w2*y2 + x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
+							z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*y2 + x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
 #endif
 						}
 					}
@@ -1739,6 +2200,124 @@ static uint8 *resample_row_hv_2(uint8 *out, uint8 *in_near, uint8 *in_far, int w
 	return out;
 }
 
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+// resample_row_hv_2 eight pixels at a time, ported from stb_image 2.x; bit-identical
+static uint8 *resample_row_hv_2_simd(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+	// need to generate 2x2 samples for every one in input
+	int i = 0, t0, t1;
+
+	if (w == 1) {
+		out[0] = out[1] = div4(3 * in_near[0] + in_far[0] + 2);
+		return out;
+	}
+
+	t1 = 3 * in_near[0] + in_far[0];
+	// process groups of 8 pixels for as long as we can.
+	// note we can't handle the last pixel in a row in this loop
+	// because we need to handle the filter boundary conditions.
+	for (; i < ((w - 1) & ~7); i += 8) {
+#if defined(STBI_SSE2)
+		// load and perform the vertical filtering pass
+		// this uses 3*x + y = 4*x + (y - x)
+		__m128i zero = _mm_setzero_si128();
+		__m128i farb = _mm_loadl_epi64((__m128i *) (in_far + i));
+		__m128i nearb = _mm_loadl_epi64((__m128i *) (in_near + i));
+		__m128i farw = _mm_unpacklo_epi8(farb, zero);
+		__m128i nearw = _mm_unpacklo_epi8(nearb, zero);
+		__m128i diff = _mm_sub_epi16(farw, nearw);
+		__m128i nears = _mm_slli_epi16(nearw, 2);
+		__m128i curr = _mm_add_epi16(nears, diff); // current row
+
+		// horizontal filter works the same based on shifted vers of current
+		// row. "prev" is current row shifted right by 1 pixel; we need to
+		// insert the previous pixel value (from t1).
+		// "next" is current row shifted left by 1 pixel, with first pixel
+		// of next block of 8 pixels added in.
+		__m128i prv0 = _mm_slli_si128(curr, 2);
+		__m128i nxt0 = _mm_srli_si128(curr, 2);
+		__m128i prev = _mm_insert_epi16(prv0, t1, 0);
+		__m128i next = _mm_insert_epi16(nxt0, 3 * in_near[i + 8] + in_far[i + 8], 7);
+
+		// horizontal filter, polyphase implementation since it's convenient:
+		// even pixels = 3*cur + prev = cur*4 + (prev - cur)
+		// odd  pixels = 3*cur + next = cur*4 + (next - cur)
+		// note the shared term.
+		__m128i bias = _mm_set1_epi16(8);
+		__m128i curs = _mm_slli_epi16(curr, 2);
+		__m128i prvd = _mm_sub_epi16(prev, curr);
+		__m128i nxtd = _mm_sub_epi16(next, curr);
+		__m128i curb = _mm_add_epi16(curs, bias);
+		__m128i even = _mm_add_epi16(prvd, curb);
+		__m128i odd = _mm_add_epi16(nxtd, curb);
+
+		// interleave even and odd pixels, then undo scaling.
+		__m128i int0 = _mm_unpacklo_epi16(even, odd);
+		__m128i int1 = _mm_unpackhi_epi16(even, odd);
+		__m128i de0 = _mm_srli_epi16(int0, 4);
+		__m128i de1 = _mm_srli_epi16(int1, 4);
+
+		// pack and write output
+		__m128i outv = _mm_packus_epi16(de0, de1);
+		_mm_storeu_si128((__m128i *) (out + i * 2), outv);
+#elif defined(STBI_NEON)
+		// load and perform the vertical filtering pass
+		// this uses 3*x + y = 4*x + (y - x)
+		uint8x8_t farb = vld1_u8(in_far + i);
+		uint8x8_t nearb = vld1_u8(in_near + i);
+		int16x8_t diff = vreinterpretq_s16_u16(vsubl_u8(farb, nearb));
+		int16x8_t nears = vreinterpretq_s16_u16(vshll_n_u8(nearb, 2));
+		int16x8_t curr = vaddq_s16(nears, diff); // current row
+
+		// horizontal filter works the same based on shifted vers of current
+		// row. "prev" is current row shifted right by 1 pixel; we need to
+		// insert the previous pixel value (from t1).
+		// "next" is current row shifted left by 1 pixel, with first pixel
+		// of next block of 8 pixels added in.
+		int16x8_t prv0 = vextq_s16(curr, curr, 7);
+		int16x8_t nxt0 = vextq_s16(curr, curr, 1);
+		int16x8_t prev = vsetq_lane_s16(t1, prv0, 0);
+		int16x8_t next = vsetq_lane_s16(3 * in_near[i + 8] + in_far[i + 8], nxt0, 7);
+
+		// horizontal filter, polyphase implementation since it's convenient:
+		// even pixels = 3*cur + prev = cur*4 + (prev - cur)
+		// odd  pixels = 3*cur + next = cur*4 + (next - cur)
+		// note the shared term.
+		int16x8_t curs = vshlq_n_s16(curr, 2);
+		int16x8_t prvd = vsubq_s16(prev, curr);
+		int16x8_t nxtd = vsubq_s16(next, curr);
+		int16x8_t even = vaddq_s16(curs, prvd);
+		int16x8_t odd = vaddq_s16(curs, nxtd);
+
+		// undo scaling and round, then store with even/odd phases interleaved
+		uint8x8x2_t o;
+		o.val[0] = vqrshrun_n_s16(even, 4);
+		o.val[1] = vqrshrun_n_s16(odd, 4);
+		vst2_u8(out + i * 2, o);
+#endif
+
+		// "previous" value for next iter
+		t1 = 3 * in_near[i + 7] + in_far[i + 7];
+	}
+
+	t0 = t1;
+	t1 = 3 * in_near[i] + in_far[i];
+	out[i * 2] = div16(3 * t1 + t0 + 8);
+
+	for (++i; i < w; ++i) {
+		t0 = t1;
+		t1 = 3 * in_near[i] + in_far[i];
+		out[i * 2 - 1] = div16(3 * t0 + t1 + 8);
+		out[i * 2] = div16(3 * t1 + t0 + 8);
+	}
+	out[w * 2 - 1] = div4(t1 + 2);
+
+	STBI_NOTUSED(hs);
+
+	return out;
+}
+#endif
+
 static uint8 *resample_row_generic(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
 {
 	// resample with nearest-neighbor
@@ -1788,6 +2367,164 @@ void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func)
 }
 #endif
 
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+// YCbCr_to_RGB_row eight pixels at a time, with the same 16.16 fixed point math in
+// 32 bit lanes, so the output is identical. SSE2 has no 32 bit multiply, so pmaddwd
+// multiplies (cr, cb) pairs by 16 bit coefficients and the part of a coefficient
+// above that range is added as a shift of cr or cb
+static void YCbCr_to_RGB_simd(uint8 *out, const uint8 *y, const uint8 *pcb, const uint8 *pcr, int count, int step)
+{
+	int i = 0;
+
+#if defined(STBI_SSE2)
+	__m128i zero = _mm_setzero_si128();
+	__m128i bias = _mm_set1_epi16(128);
+	__m128i round = _mm_set1_epi32(32768);
+	__m128i alpha = _mm_set1_epi16(255);
+	// 1.402 = 1 + 0.402, -0.71414 = -0.5 - 0.21414 and 1.772 = 2 - 0.228
+	__m128i cr_r = _mm_setr_epi16(float2fixed(1.40200f) - (1 << 16), 0, float2fixed(1.40200f) - (1 << 16), 0,
+		float2fixed(1.40200f) - (1 << 16), 0, float2fixed(1.40200f) - (1 << 16), 0);
+	__m128i crcb_g = _mm_setr_epi16((1 << 15) - float2fixed(0.71414f), -float2fixed(0.34414f), (1 << 15) - float2fixed(0.71414f), -float2fixed(0.34414f),
+		(1 << 15) - float2fixed(0.71414f), -float2fixed(0.34414f), (1 << 15) - float2fixed(0.71414f), -float2fixed(0.34414f));
+	__m128i cb_b = _mm_setr_epi16(0, float2fixed(1.77200f) - (1 << 17), 0, float2fixed(1.77200f) - (1 << 17),
+		0, float2fixed(1.77200f) - (1 << 17), 0, float2fixed(1.77200f) - (1 << 17));
+
+	for (; i + 8 <= count; i += 8, out += 8 * step) {
+		__m128i yw = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (y + i)), zero);
+		__m128i cbw = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (pcb + i)), zero), bias);
+		__m128i crw = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (pcr + i)), zero), bias);
+		__m128i r[2], g[2], b[2];
+		int half;
+
+		for (half = 0; half < 2; ++half) {
+			// 32 bit lanes holding cr in the low and cb in the high 16 bits
+			__m128i crcb = half ? _mm_unpackhi_epi16(crw, cbw) : _mm_unpacklo_epi16(crw, cbw);
+			__m128i cr = _mm_srai_epi32(_mm_slli_epi32(crcb, 16), 16);
+			__m128i cb = _mm_srai_epi32(crcb, 16);
+			__m128i y_fixed = _mm_add_epi32(_mm_slli_epi32(half ? _mm_unpackhi_epi16(yw, zero) : _mm_unpacklo_epi16(yw, zero), 16), round);
+			r[half] = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(y_fixed, _mm_slli_epi32(cr, 16)), _mm_madd_epi16(crcb, cr_r)), 16);
+			g[half] = _mm_srai_epi32(_mm_sub_epi32(_mm_add_epi32(y_fixed, _mm_madd_epi16(crcb, crcb_g)), _mm_slli_epi32(cr, 15)), 16);
+			b[half] = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(y_fixed, _mm_slli_epi32(cb, 17)), _mm_madd_epi16(crcb, cb_b)), 16);
+		}
+
+		{
+			// clamp to 0..255 while packing, then interleave to r g b 255
+			__m128i rg = _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), _mm_packs_epi32(g[0], g[1]));
+			__m128i ba = _mm_packus_epi16(_mm_packs_epi32(b[0], b[1]), alpha);
+			__m128i rgi = _mm_unpacklo_epi8(rg, _mm_srli_si128(rg, 8));
+			__m128i bai = _mm_unpacklo_epi8(ba, _mm_srli_si128(ba, 8));
+			__m128i o0 = _mm_unpacklo_epi16(rgi, bai);
+			__m128i o1 = _mm_unpackhi_epi16(rgi, bai);
+			if (step == 4) {
+				_mm_storeu_si128((__m128i *) (out + 0), o0);
+				_mm_storeu_si128((__m128i *) (out + 16), o1);
+			}
+			else {
+				// four byte stores 3 bytes apart, the scalar code writes the same bytes
+				uint8 rgba[32];
+				int k;
+				_mm_storeu_si128((__m128i *) (rgba + 0), o0);
+				_mm_storeu_si128((__m128i *) (rgba + 16), o1);
+				for (k = 0; k < 8; ++k)
+					memcpy(out + k * step, rgba + k * 4, 4);
+			}
+		}
+	}
+#elif defined(STBI_NEON)
+	int16x8_t bias = vdupq_n_s16(128);
+	int32x4_t round = vdupq_n_s32(32768);
+
+	for (; i + 8 <= count; i += 8, out += 8 * step) {
+		int16x8_t yw = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + i)));
+		int16x8_t cbw = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(pcb + i))), bias);
+		int16x8_t crw = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(pcr + i))), bias);
+		int16x4_t r[2], g[2], b[2];
+		int half;
+
+		for (half = 0; half < 2; ++half) {
+			int32x4_t cr = vmovl_s16(half ? vget_high_s16(crw) : vget_low_s16(crw));
+			int32x4_t cb = vmovl_s16(half ? vget_high_s16(cbw) : vget_low_s16(cbw));
+			int32x4_t y_fixed = vaddq_s32(vshll_n_s16(half ? vget_high_s16(yw) : vget_low_s16(yw), 16), round);
+			r[half] = vqmovn_s32(vshrq_n_s32(vmlaq_n_s32(y_fixed, cr, float2fixed(1.40200f)), 16));
+			g[half] = vqmovn_s32(vshrq_n_s32(vmlaq_n_s32(vmlaq_n_s32(y_fixed, cr, -float2fixed(0.71414f)), cb, -float2fixed(0.34414f)), 16));
+			b[half] = vqmovn_s32(vshrq_n_s32(vmlaq_n_s32(y_fixed, cb, float2fixed(1.77200f)), 16));
+		}
+
+		if (step == 4) {
+			uint8x8x4_t o;
+			o.val[0] = vqmovun_s16(vcombine_s16(r[0], r[1]));
+			o.val[1] = vqmovun_s16(vcombine_s16(g[0], g[1]));
+			o.val[2] = vqmovun_s16(vcombine_s16(b[0], b[1]));
+			o.val[3] = vdup_n_u8(255);
+			vst4_u8(out, o);
+		}
+		else {
+			uint8x8x3_t o;
+			o.val[0] = vqmovun_s16(vcombine_s16(r[0], r[1]));
+			o.val[1] = vqmovun_s16(vcombine_s16(g[0], g[1]));
+			o.val[2] = vqmovun_s16(vcombine_s16(b[0], b[1]));
+			vst3_u8(out, o);
+		}
+	}
+#endif
+
+	// the rest of the row
+	if (i < count)
+		YCbCr_to_RGB_row(out, y + i, pcb + i, pcr + i, count - i, step);
+}
+#endif
+
+#ifdef STBI_SSE2
+#ifdef _MSC_VER
+static int sse2_available(void)
+{
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] >> 26) & 1;
+}
+#else
+static int sse2_available(void)
+{
+	return __builtin_cpu_supports("sse2") != 0;
+}
+#endif
+#endif
+
+static int jpeg_simd_enabled = 1;
+
+void stbi_set_jpeg_simd(int flag_true_if_should_use_simd)
+{
+	jpeg_simd_enabled = flag_true_if_should_use_simd;
+}
+
+int stbi_jpeg_simd_available(void)
+{
+#if defined(STBI_SSE2)
+	return sse2_available();
+#elif defined(STBI_NEON)
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+#ifndef STBI_SIMD
+static void setup_jpeg_kernels(jpeg *z)
+{
+	z->idct_block_kernel = idct_block;
+	z->YCbCr_to_RGB_kernel = YCbCr_to_RGB_row;
+	z->resample_row_hv_2_kernel = resample_row_hv_2;
+
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+	if (jpeg_simd_enabled && stbi_jpeg_simd_available()) {
+		z->idct_block_kernel = idct_block_simd;
+		z->YCbCr_to_RGB_kernel = YCbCr_to_RGB_simd;
+		z->resample_row_hv_2_kernel = resample_row_hv_2_simd;
+	}
+#endif
+}
+#endif
+
 
 // clean up the temporary component buffers
 static void cleanup_jpeg(jpeg *j)
@@ -1821,6 +2558,9 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
 	// validate req_comp
 	if (req_comp < 0 || req_comp > 4) return epuc("bad req_comp", "Internal error");
 	z->s->img_n = 0;
+#ifndef STBI_SIMD
+	setup_jpeg_kernels(z);
+#endif
 
 	// load a jpeg image from whichever source
 	if (!decode_jpeg_image(z)) { cleanup_jpeg(z); return NULL; }
@@ -1860,7 +2600,11 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
 			if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
 			else if (r->hs == 1 && r->vs == 2) r->resample = resample_row_v_2;
 			else if (r->hs == 2 && r->vs == 1) r->resample = resample_row_h_2;
+#ifdef STBI_SIMD
 			else if (r->hs == 2 && r->vs == 2) r->resample = resample_row_hv_2;
+#else
+			else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+#endif
 			else                               r->resample = resample_row_generic;
 		}
 
@@ -1891,7 +2635,7 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
 #ifdef STBI_SIMD
 					stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
 #else
-					YCbCr_to_RGB_row(out, y, coutput[1], coutput[2], z->s->img_x, n);
+					z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
 #endif
 				}
 				else
@@ -1959,6 +2703,7 @@ static int stbi_jpeg_info(stbi *s, int *x, int *y, int *comp)
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
 //      - fast huffman
+//      - table-driven inflate with literal pairs and 64 bit refills (stbi_set_fast_inflate)
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
 #define ZFAST_BITS  9 // accelerate all cases in default tables
@@ -1993,7 +2738,7 @@ stbi_inline static int bit_reverse(int v, int bits)
 	return bitreverse16(v) >> (16 - bits);
 }
 
-static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
+static int zbuild_huffman(zhuffman *z, const uint8 *sizelist, int num)
 {
 	int i, k = 0;
 	int code, next_code[16], sizes[17];
@@ -2005,7 +2750,7 @@ static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
 		++sizes[sizelist[i]];
 	sizes[0] = 0;
 	for (i = 1; i < 16; ++i)
-		assert(sizes[i] <= (1 << i));
+		if (sizes[i] > (1 << i)) return e("bad sizes", "Corrupt PNG");
 	code = 0;
 	for (i = 1; i < 16; ++i) {
 		next_code[i] = code;
@@ -2038,6 +2783,38 @@ static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
 	return 1;
 }
 
+// lookup tables for the fast inflate path. a table entry decodes the symbol(s) in
+// the low bits of the bit buffer:
+//    bits 0-4    bits to consume
+//    bits 5-7    ZFAST_* entry kind
+//    bits 8-11   extra bits of a length or distance, or index bits of a subtable
+//    bits 16-31  length or distance base, subtable offset, or one or two literals
+// codes longer than the table bits continue in a subtable after the main table
+#define ZFAST_LENGTH_BITS     11
+#define ZFAST_DISTANCE_BITS   8
+
+// a code that does not fill the main table index can hold up to 2^(15-bits) entries
+// of subtable, every symbol can start one since the codes may be incomplete
+#define ZFAST_LENGTH_SIZE     ((1 << ZFAST_LENGTH_BITS) + 288 * (1 << (15 - ZFAST_LENGTH_BITS)))
+#define ZFAST_DISTANCE_SIZE   ((1 << ZFAST_DISTANCE_BITS) + 32 * (1 << (15 - ZFAST_DISTANCE_BITS)))
+
+enum
+{
+	ZFAST_INVALID,
+	ZFAST_LITERAL,
+	ZFAST_LITERAL2,
+	ZFAST_MATCH,        // a length, or a distance in the distance table
+	ZFAST_END,
+	ZFAST_SUBTABLE
+};
+
+typedef struct
+{
+	uint32 length[ZFAST_LENGTH_SIZE];
+	uint32 distance[ZFAST_DISTANCE_SIZE];
+	int fixed; // the tables hold the fixed codes, no need to build them again
+} zfast;
+
 // zlib-from-memory implementation for PNG reading
 //    because PNG allows splitting the zlib stream arbitrarily,
 //    and it's annoying structurally to have PNG call ZLIB call PNG,
@@ -2056,6 +2833,9 @@ typedef struct
 	int   z_expandable;
 
 	zhuffman z_length, z_distance;
+	zfast *fast;     // allocated with the first block that uses it
+	int fast_block;  // the current block decodes through fast
+	int hit_end;     // zhuffman_decode has already lent itself the zeros past the input
 } zbuf;
 
 stbi_inline static int zget8(zbuf *z)
@@ -2068,7 +2848,7 @@ static void fill_bits(zbuf *z)
 {
 	do {
 		assert(z->code_buffer < (1U << z->num_bits));
-		z->code_buffer |= zget8(z) << z->num_bits;
+		z->code_buffer |= (uint32)zget8(z) << z->num_bits;
 		z->num_bits += 8;
 	} while (z->num_bits <= 24);
 }
@@ -2086,7 +2866,16 @@ stbi_inline static unsigned int zreceive(zbuf *z, int n)
 stbi_inline static int zhuffman_decode(zbuf *a, zhuffman *z)
 {
 	int b, s, k;
-	if (a->num_bits < 16) fill_bits(a);
+	if (a->num_bits < 16) {
+		if (a->zbuffer >= a->zbuffer_end) {
+			// out of input: the last code may still be shorter than 16 bits, so take 16 zero
+			// bits once, and fail the next time instead of decoding zeros into output forever
+			if (a->hit_end) return -1;
+			a->hit_end = 1;
+			a->num_bits += 16;
+		}
+		else fill_bits(a);
+	}
 	b = z->fast[a->code_buffer & ZFAST_MASK];
 	if (b < 0xffff) {
 		s = z->size[b];
@@ -2141,6 +2930,237 @@ static int dist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
 static int dist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
 
+#define zfast_entry(kind, bits, extra, payload)  ((uint32) (bits) | ((kind) << 5) | ((extra) << 8) | ((uint32) (payload) << 16))
+#define zfast_bits(e)     ((e) & 31)
+#define zfast_kind(e)     (((e) >> 5) & 7)
+#define zfast_extra(e)    (((e) >> 8) & 15)
+#define zfast_payload(e)  ((e) >> 16)
+
+// fills one lookup table from canonical code lengths, entries[i] is the entry for symbol i
+// without its code length. zbuild_huffman has rejected over-subscribed lengths already
+static int zbuild_fast_table(uint32 *table, int table_bits, int size, const uint8 *sizelist, const uint32 *entries, int num)
+{
+	int i, s, code, next_code[16], sizes[17];
+	int offset = 1 << table_bits;
+	uint8 subtable_bits[1 << ZFAST_LENGTH_BITS];
+	int mask = (1 << table_bits) - 1;
+
+	memset(sizes, 0, sizeof(sizes));
+	for (i = 0; i < num; ++i)
+		++sizes[sizelist[i]];
+	sizes[0] = 0;
+	code = 0;
+	for (i = 1; i < 16; ++i) {
+		next_code[i] = code;
+		code = (code + sizes[i]) << 1;
+	}
+
+	// size the subtables: the longest code behind each main table index decides
+	memset(table, 0, (1 << table_bits) * sizeof(*table));
+	memset(subtable_bits, 0, sizeof(subtable_bits));
+	{
+		int codes[16];
+		memcpy(codes, next_code, sizeof(codes));
+		for (i = 0; i < num; ++i) {
+			s = sizelist[i];
+			if (s > table_bits) {
+				int prefix = bit_reverse(codes[s], s) & mask;
+				if (s - table_bits > subtable_bits[prefix])
+					subtable_bits[prefix] = (uint8)(s - table_bits);
+			}
+			if (s) ++codes[s];
+		}
+	}
+	for (i = 0; i <= mask; ++i) {
+		if (subtable_bits[i]) {
+			if (offset + (1 << subtable_bits[i]) > size) return e("bad codelengths", "Corrupt PNG");
+			table[i] = zfast_entry(ZFAST_SUBTABLE, table_bits, subtable_bits[i], offset);
+			memset(table + offset, 0, (1 << subtable_bits[i]) * sizeof(*table));
+			offset += 1 << subtable_bits[i];
+		}
+	}
+
+	// every entry whose low bits start with a code holds its symbol
+	for (i = 0; i < num; ++i) {
+		s = sizelist[i];
+		if (s) {
+			int k = bit_reverse(next_code[s], s);
+			if (s <= table_bits) {
+				for (; k <= mask; k += 1 << s)
+					table[k] = entries[i] | s;
+			}
+			else {
+				uint32 link = table[k & mask];
+				uint32 *sub = table + zfast_payload(link);
+				int sub_size = 1 << zfast_extra(link);
+				for (k >>= table_bits; k < sub_size; k += 1 << (s - table_bits))
+					sub[k] = entries[i] | (s - table_bits);
+			}
+			++next_code[s];
+		}
+	}
+	return 1;
+}
+
+// pairs up literals whose codes both fit the main table index. going from the top
+// down, the second literal's entry at i >> bits is always still a single literal
+static void zpair_literals(uint32 *table, int table_bits)
+{
+	int i;
+	for (i = (1 << table_bits) - 1; i >= 0; --i) {
+		uint32 first = table[i], second;
+		int bits = zfast_bits(first);
+		if (zfast_kind(first) != ZFAST_LITERAL || bits >= table_bits) continue;
+		second = table[i >> bits];
+		if (zfast_kind(second) != ZFAST_LITERAL || bits + (int)zfast_bits(second) > table_bits) continue;
+		table[i] = zfast_entry(ZFAST_LITERAL2, bits + zfast_bits(second), 0, zfast_payload(first) | zfast_payload(second) << 8);
+	}
+}
+
+static int zbuild_fast_tables(zfast *f, const uint8 *length_sizes, int num_lengths, const uint8 *distance_sizes, int num_distances)
+{
+	uint32 entries[288];
+	int i;
+	for (i = 0; i < 288; ++i) {
+		if (i < 256)       entries[i] = zfast_entry(ZFAST_LITERAL, 0, 0, i);
+		else if (i == 256) entries[i] = zfast_entry(ZFAST_END, 0, 0, 0);
+		else if (i < 286)  entries[i] = zfast_entry(ZFAST_MATCH, 0, length_extra[i - 257], length_base[i - 257]);
+		else               entries[i] = zfast_entry(ZFAST_INVALID, 0, 0, 0);
+	}
+	if (!zbuild_fast_table(f->length, ZFAST_LENGTH_BITS, ZFAST_LENGTH_SIZE, length_sizes, entries, num_lengths)) return 0;
+	zpair_literals(f->length, ZFAST_LENGTH_BITS);
+
+	for (i = 0; i < 32; ++i)
+		entries[i] = i < 30 ? zfast_entry(ZFAST_MATCH, 0, dist_extra[i], dist_base[i]) : zfast_entry(ZFAST_INVALID, 0, 0, 0);
+	return zbuild_fast_table(f->distance, ZFAST_DISTANCE_BITS, ZFAST_DISTANCE_SIZE, distance_sizes, entries, num_distances);
+}
+
+stbi_inline static uint64 zload64(const uint8 *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM) || defined(_M_ARM64)
+	uint64 v;
+	memcpy(&v, p, 8);
+	return v;
+#else
+	return (uint64)p[0] | (uint64)p[1] << 8 | (uint64)p[2] << 16 | (uint64)p[3] << 24 |
+		(uint64)p[4] << 32 | (uint64)p[5] << 40 | (uint64)p[6] << 48 | (uint64)p[7] << 56;
+#endif
+}
+
+// the fast inflate loop. it runs while 8 input bytes can be loaded at once and the output
+// has room for a whole match plus the overrun of 8 byte copies; after a refill the bit
+// buffer holds at least 56 bits, enough for the longest length and distance with their
+// extra bits. returns 1 at the end of the block, 0 on an error, and 2 when the rest of
+// the block is left to parse_huffman_block
+static int parse_huffman_block_fast(zbuf *a)
+{
+	const int margin = 258 + 8;
+	zfast *f = a->fast;
+	uint8 *in = a->zbuffer;
+	uint8 *out = (uint8 *)a->zout;
+	uint64 bits = a->code_buffer;
+	int num_bits = a->num_bits;
+	int result = 2;
+
+	for (;;) {
+		uint32 entry;
+		int n, len, dist;
+		uint8 *p;
+
+		if (a->zbuffer_end - in < 8) break;
+		if ((uint8 *)a->zout_end - out < margin) {
+			if (!a->z_expandable) break;
+			a->zout = (char *)out;
+			if (!expand(a, margin)) { result = 0; break; }
+			out = (uint8 *)a->zout;
+		}
+
+		// refill to 56-63 bits, bits above num_bits repeat the next input bytes
+		bits |= zload64(in) << num_bits;
+		in += (63 - num_bits) >> 3;
+		num_bits |= 56;
+
+		entry = f->length[bits & ((1 << ZFAST_LENGTH_BITS) - 1)];
+		if (zfast_kind(entry) == ZFAST_SUBTABLE) {
+			bits >>= ZFAST_LENGTH_BITS;
+			num_bits -= ZFAST_LENGTH_BITS;
+			entry = f->length[zfast_payload(entry) + (bits & ((1 << zfast_extra(entry)) - 1))];
+		}
+		n = zfast_bits(entry);
+		bits >>= n;
+		num_bits -= n;
+
+		if (zfast_kind(entry) == ZFAST_LITERAL2) {
+			out[0] = (uint8)zfast_payload(entry);
+			out[1] = (uint8)(zfast_payload(entry) >> 8);
+			out += 2;
+			continue;
+		}
+		if (zfast_kind(entry) == ZFAST_LITERAL) {
+			*out++ = (uint8)zfast_payload(entry);
+			continue;
+		}
+		if (zfast_kind(entry) != ZFAST_MATCH) {
+			if (zfast_kind(entry) == ZFAST_END) result = 1;
+			else result = e("bad huffman code", "Corrupt PNG");
+			break;
+		}
+
+		n = zfast_extra(entry);
+		len = zfast_payload(entry) + (int)(bits & ((1 << n) - 1));
+		bits >>= n;
+		num_bits -= n;
+
+		entry = f->distance[bits & ((1 << ZFAST_DISTANCE_BITS) - 1)];
+		if (zfast_kind(entry) == ZFAST_SUBTABLE) {
+			bits >>= ZFAST_DISTANCE_BITS;
+			num_bits -= ZFAST_DISTANCE_BITS;
+			entry = f->distance[zfast_payload(entry) + (bits & ((1 << zfast_extra(entry)) - 1))];
+		}
+		if (zfast_kind(entry) != ZFAST_MATCH) { result = e("bad huffman code", "Corrupt PNG"); break; }
+		n = zfast_bits(entry);
+		bits >>= n;
+		num_bits -= n;
+		n = zfast_extra(entry);
+		dist = zfast_payload(entry) + (int)(bits & ((1 << n) - 1));
+		bits >>= n;
+		num_bits -= n;
+
+		if (out - (uint8 *)a->zout_start < dist) { result = e("bad dist", "Corrupt PNG"); break; }
+		p = out - dist;
+		if (dist >= 8) {
+			// 8 bytes at a time, may write up to 7 bytes past the match
+			uint8 *end = out + len;
+			do {
+				memcpy(out, p, 8);
+				out += 8;
+				p += 8;
+			} while (out < end);
+			out = end;
+		}
+		else if (dist == 1) {
+			memset(out, *p, len);
+			out += len;
+		}
+		else {
+			while (len--)
+				*out++ = *p++;
+		}
+	}
+
+	// give back whole input bytes until the rest fits the 32 bit buffer. nothing is given
+	// back without a refill, the bits may then include the zeros fill_bits reads past the end
+	a->zout = (char *)out;
+	if (num_bits > 32) {
+		in -= (num_bits - 25) >> 3;
+		num_bits -= ((num_bits - 25) >> 3) * 8;
+	}
+	a->zbuffer = in;
+	a->num_bits = num_bits;
+	a->code_buffer = (uint32)(bits & (((uint64)1 << num_bits) - 1));
+	return result;
+}
+
 static int parse_huffman_block(zbuf *a)
 {
 	for (;;) {
@@ -2192,10 +3212,11 @@ static int compute_huffman_codes(zbuf *a)
 	n = 0;
 	while (n < hlit + hdist) {
 		int c = zhuffman_decode(a, &z_codelength);
-		assert(c >= 0 && c < 19);
+		if (c < 0 || c >= 19) return e("bad codelengths", "Corrupt PNG");
 		if (c < 16)
 			lencodes[n++] = (uint8)c;
 		else if (c == 16) {
+			if (n == 0) return e("bad codelengths", "Corrupt PNG");
 			c = zreceive(a, 2) + 3;
 			memset(lencodes + n, lencodes[n - 1], c);
 			n += c;
@@ -2206,7 +3227,6 @@ static int compute_huffman_codes(zbuf *a)
 			n += c;
 		}
 		else {
-			assert(c == 18);
 			c = zreceive(a, 7) + 11;
 			memset(lencodes + n, 0, c);
 			n += c;
@@ -2215,6 +3235,10 @@ static int compute_huffman_codes(zbuf *a)
 	if (n != hlit + hdist) return e("bad codelengths", "Corrupt PNG");
 	if (!zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
 	if (!zbuild_huffman(&a->z_distance, lencodes + hlit, hdist)) return 0;
+	if (a->fast_block) {
+		a->fast->fixed = 0;
+		if (!zbuild_fast_tables(a->fast, lencodes, hlit, lencodes + hlit, hdist)) return 0;
+	}
 	return 1;
 }
 
@@ -2260,23 +3284,42 @@ static int parse_zlib_header(zbuf *a)
 	return 1;
 }
 
-// @TODO: should statically initialize these for optimal thread safety
-static uint8 default_length[288], default_distance[32];
-static void init_defaults(void)
-{
-	int i;   // use <= to match clearly with spec
-	for (i = 0; i <= 143; ++i)     default_length[i] = 8;
-	for (; i <= 255; ++i)     default_length[i] = 9;
-	for (; i <= 279; ++i)     default_length[i] = 7;
-	for (; i <= 287; ++i)     default_length[i] = 8;
+// fixed huffman code lengths, statically initialized so concurrent decodes never build them
+// lengths 0-143: 8, 144-255: 9, 256-279: 7, 280-287: 8
+static const uint8 default_length[288] = {
+	8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+	8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+	8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+	8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+	8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+	9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+	9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+	9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+	7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,8,8,8,8,8,8,8,8,
+};
+static const uint8 default_distance[32] = {
+	5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,
+};
+
+#ifdef STBI_THREAD_LOCAL
+STBI_THREAD_LOCAL int stbi_png_partial;
+#else
+int stbi_png_partial;
+#endif // a quick hack to only allow decoding some of a PNG... I should implement real streaming support instead
+static int fast_inflate_enabled = 1;
 
-	for (i = 0; i <= 31; ++i)     default_distance[i] = 5;
+void stbi_set_fast_inflate(int flag_true_if_should_use_fast_inflate)
+{
+	fast_inflate_enabled = flag_true_if_should_use_fast_inflate;
 }
 
-int stbi_png_partial; // a quick hack to only allow decoding some of a PNG... I should implement real streaming support instead
 static int parse_zlib(zbuf *a, int parse_header)
 {
 	int final, type;
+	int fast = fast_inflate_enabled;
+	// building the fast tables costs about as much as inflating a few thousand bytes
+	// bit-by-bit, so small streams, and blocks after a small or a stored block, go without
+	int last_block_bytes = a->zbuffer_end - a->zbuffer >= 4096 ? 1 << 30 : 0;
 	if (parse_header)
 		if (!parse_zlib_header(a)) return 0;
 	a->num_bits = 0;
@@ -2286,21 +3329,40 @@ static int parse_zlib(zbuf *a, int parse_header)
 		type = zreceive(a, 2);
 		if (type == 0) {
 			if (!parse_uncompressed_block(a)) return 0;
+			last_block_bytes = 0;
 		}
 		else if (type == 3) {
 			return 0;
 		}
 		else {
+			int block_start = (int)(a->zout - a->zout_start);
+			a->fast_block = fast && last_block_bytes >= 4096;
+			if (a->fast_block && !a->fast) {
+				// without memory for the tables the bit-by-bit decoder still works
+				a->fast = (zfast *)malloc(sizeof(zfast));
+				if (a->fast) a->fast->fixed = 0;
+				else a->fast_block = 0;
+			}
 			if (type == 1) {
 				// use fixed code lengths
-				if (!default_distance[31]) init_defaults();
 				if (!zbuild_huffman(&a->z_length, default_length, 288)) return 0;
 				if (!zbuild_huffman(&a->z_distance, default_distance, 32)) return 0;
+				if (a->fast_block && !a->fast->fixed) {
+					if (!zbuild_fast_tables(a->fast, default_length, 288, default_distance, 32)) return 0;
+					a->fast->fixed = 1;
+				}
 			}
 			else {
 				if (!compute_huffman_codes(a)) return 0;
 			}
-			if (!parse_huffman_block(a)) return 0;
+			if (a->fast_block) {
+				// the fast loop leaves the last few bytes of input or output to the careful one
+				int r = parse_huffman_block_fast(a);
+				if (r == 0) return 0;
+				if (r == 2 && !parse_huffman_block(a)) return 0;
+			}
+			else if (!parse_huffman_block(a)) return 0;
+			last_block_bytes = (int)(a->zout - a->zout_start) - block_start;
 		}
 		if (stbi_png_partial && a->zout - a->zout_start > 65536)
 			break;
@@ -2310,12 +3372,17 @@ static int parse_zlib(zbuf *a, int parse_header)
 
 static int do_zlib(zbuf *a, char *obuf, int olen, int exp, int parse_header)
 {
+	int result;
 	a->zout_start = obuf;
 	a->zout = obuf;
 	a->zout_end = obuf + olen;
 	a->z_expandable = exp;
 
-	return parse_zlib(a, parse_header);
+	a->fast = NULL;
+	a->hit_end = 0;
+	result = parse_zlib(a, parse_header);
+	free(a->fast);
+	return result;
 }
 
 char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen)
@@ -2645,18 +3712,50 @@ static int expand_palette(png *a, uint8 *palette, int len, int pal_img_n)
 	return 1;
 }
 
-static int stbi_unpremultiply_on_load = 0;
-static int stbi_de_iphone_flag = 0;
+// process wide settings, a thread can override them for its own decodes
+static int stbi_unpremultiply_on_load_global = 0;
+static int stbi_de_iphone_flag_global = 0;
 
 void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultiply)
 {
-	stbi_unpremultiply_on_load = flag_true_if_should_unpremultiply;
+	stbi_unpremultiply_on_load_global = flag_true_if_should_unpremultiply;
 }
 void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert)
 {
-	stbi_de_iphone_flag = flag_true_if_should_convert;
+	stbi_de_iphone_flag_global = flag_true_if_should_convert;
 }
 
+#ifdef STBI_THREAD_LOCAL
+static STBI_THREAD_LOCAL int stbi_unpremultiply_on_load_local, stbi_unpremultiply_on_load_set;
+static STBI_THREAD_LOCAL int stbi_de_iphone_flag_local, stbi_de_iphone_flag_set;
+
+void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply)
+{
+	stbi_unpremultiply_on_load_local = flag_true_if_should_unpremultiply;
+	stbi_unpremultiply_on_load_set = 1;
+}
+void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert)
+{
+	stbi_de_iphone_flag_local = flag_true_if_should_convert;
+	stbi_de_iphone_flag_set = 1;
+}
+
+#define stbi_unpremultiply_on_load (stbi_unpremultiply_on_load_set ? stbi_unpremultiply_on_load_local : stbi_unpremultiply_on_load_global)
+#define stbi_de_iphone_flag (stbi_de_iphone_flag_set ? stbi_de_iphone_flag_local : stbi_de_iphone_flag_global)
+#else
+void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply)
+{
+	stbi_unpremultiply_on_load_global = flag_true_if_should_unpremultiply;
+}
+void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert)
+{
+	stbi_de_iphone_flag_global = flag_true_if_should_convert;
+}
+
+#define stbi_unpremultiply_on_load stbi_unpremultiply_on_load_global
+#define stbi_de_iphone_flag stbi_de_iphone_flag_global
+#endif
+
 static void stbi_de_iphone(png *z)
 {
 	stbi *s = z->s;
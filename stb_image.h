@@ -458,6 +458,18 @@ extern "C" {
 	// flip the image vertically, so the first pixel in the output array is the bottom left
 	STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+	// JPEG decodes use SSE2 or NEON kernels for the IDCT, upsampling and color
+	// conversion where the CPU has them. pass 0 to use the scalar code instead,
+	// e.g. to compare the two; affects decodes started afterwards on all threads
+	STBIDEF void stbi_set_jpeg_simd(int flag_true_if_should_use_simd);
+	// whether SIMD kernels were compiled in and the CPU supports them
+	STBIDEF int  stbi_jpeg_simd_available(void);
+
+	// zlib streams (all of PNG) inflate through multi-symbol lookup tables and a
+	// 64 bit bit buffer. pass 0 to use the original bit-by-bit decoder instead;
+	// affects decodes started afterwards on all threads
+	STBIDEF void stbi_set_fast_inflate(int flag_true_if_should_use_fast_inflate);
+
 	// ZLIB client - used by PNG, available for other purposes
 
 	STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);